@@ -14,19 +14,16 @@ static void BM_ETSRunthrough (benchmark::State &state)
     int size = 0x80;
 
     int r;
-    pthread_mutex_init (&__ets_chunk_tracker.ct_access, NULL);
     //ets_chunk_t *chunk = NULL;
     //r = ets_chunk_alloc (&chunk);
     //printf ("[test]\tallocated chunk at %p (r = %i)\n", chunk, r);
     if (ETS_ISERR (r)) return;
-    ets_heap_t *tl_heap = (ets_heap_t *)malloc (24 + 20 * sizeof (ets_lkg_t));
+    ets_heap_t *tl_heap = (ets_heap_t *)aligned_alloc (ETS_CACHE_LINE_SIZE, ETS_HEAP_SIZE);
     tl_heap->h_owning_heap = NULL;
-    tl_heap->h_nlkgs = 20;
+    tl_heap->h_nlkgs = ETS_HEAP_NLKGS;
     for (size_t i = 0; i < tl_heap->h_nlkgs; ++i) {
         ets_lkg_init (&tl_heap->h_lkgs[i], i, tl_heap);
     }
-    //r = ets_chunk_bind (chunk, tl_heap, &__ets_chunk_tracker);
-    //printf ("[test]\tets_chunk_bind (r = %i)\n", r);
 
     srand (0);
 
@@ -71,20 +68,12 @@ int main (int argc, char **argv)
     void **objects = (void **)malloc (sizeof *objects * NALLOC);
     int size = 0x80;
 
-    int r;
-    pthread_mutex_init (&__ets_chunk_tracker.ct_access, NULL);
-    ets_chunk_t *chunk = NULL;
-    r = ets_chunk_alloc (&chunk);
-    //printf ("[test]\tallocated chunk at %p (r = %i)\n", chunk, r);
-    if (ETS_ISERR (r)) return 1;
-    ets_heap_t *tl_heap = (ets_heap_t *)malloc (24 + 20 * sizeof (ets_lkg_t));
+    ets_heap_t *tl_heap = (ets_heap_t *)aligned_alloc (ETS_CACHE_LINE_SIZE, ETS_HEAP_SIZE);
     tl_heap->h_owning_heap = NULL;
-    tl_heap->h_nlkgs = 20;
+    tl_heap->h_nlkgs = ETS_HEAP_NLKGS;
     for (size_t i = 0; i < tl_heap->h_nlkgs; ++i) {
         ets_lkg_init (&tl_heap->h_lkgs[i], i, tl_heap);
     }
-    r = ets_chunk_bind (chunk, tl_heap, &__ets_chunk_tracker);
-    //printf ("[test]\tets_chunk_bind (r = %i)\n", r);
 
     srand (0);
 
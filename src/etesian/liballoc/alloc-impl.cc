@@ -8,6 +8,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include <etesian/liballoc/alloc-impl.h>
 
@@ -18,7 +19,10 @@ static int ets_on_threadkill_tid ();
 //! Initialize a block.
 //! Thread-Safe: 0
 static int ets_block_init (ets_block_t *);
-//! Individually free a block.
+//! Individually free a block: its memory goes back to the kernel after a
+//! while, unless its chunk empties first, but it stays mapped, and is reused
+//! before fresh blocks are. If that empties its chunk, the chunk is retired
+//! to the chunk cache.
 //! Thread-safe: SINGLE-OWNING
 static int ets_block_free (ets_block_t *);
 static int ets_block_clean (ets_block_t *);
@@ -28,9 +32,75 @@ static int ets_block_alloc_object (ets_block_t *block, void **object);
 //! Deallocate object from block.
 //! Thread-safe: 1
 static int ets_block_dealloc_object (ets_block_t *block, void *object);
+//! Take up to `want` objects off the free lists of a block at once, with a
+//! single `b_acnt` adjustment; they come pre-linked from `*firstp` to
+//! `*lastp`. Returns how many were taken.
+//! Thread-safe: OWNING
+static size_t ets_block_alloc_chain (ets_block_t *block, size_t want, void **firstp, void **lastp);
+//! Deallocate `count` objects of a block at once, pre-linked from `first` to
+//! `last`.
+//! Thread-safe: 1
+static int ets_block_dealloc_chain (ets_block_t *block, void *first, void *last, size_t count);
+//! Act on `nreleased` objects having just been returned to the block, leaving
+//! `acnt_cache` allocated: lift it once empty, right it once it crosses half.
+//! A `pinned` release still holds one object, which it releases once the block
+//! is righted, or drops when it lifts the block.
+//! Thread-safe: 1
+static int ets_block_did_release (ets_block_t *block, size_t acnt_cache, size_t nreleased, bool pinned);
+//! Push an object onto the remote free list; lock-free.
+//! Thread-safe: 1
+static inline void ets_block_gfl_push (ets_block_t *block, void *object);
+//! Push a pre-linked chain `first`..`last` onto the remote free list; lock-free.
+//! Thread-safe: 1
+static inline void ets_block_gfl_push_chain (ets_block_t *block, void *first, void *last);
+//! Take the whole remote free list; lock-free.
+//! Thread-safe: 1
+static inline void *ets_block_gfl_collect (ets_block_t *block);
+//! Whether a block has any free object on its free lists or in its bitmaps.
+//! A block being lifted has none, as far as slides are concerned.
+//! Thread-safe: 1 (LOCKED)
+static inline bool ets_block_has_free (ets_block_t *block);
 //! Format block to object size.
 //! Thread-safe: 0.
 static int ets_block_format_to_size (ets_block_t *block, size_t new_size);
+//! Number of blocks in the spans backing a linkage.
+//! Thread-safe: 1
+static size_t ets_span_nblocks (size_t lkgi);
+//! Carve a formatted block, or span for a medium linkage, out of the span
+//! frontier; its header is written for the first time here.
+//! Thread-safe: 1
+static int ets_span_carve (struct ets_heap *root, size_t lkgi, ets_block_t **blockp);
+//! Take a run of `nblocks` blocks for a span: purged ones if a chunk can
+//! take it, otherwise off the span frontier, retiring its leftovers under
+//! `root`. Only the span entries are set; the head's header is not yet
+//! written.
+//! Thread-safe: 1
+static int ets_span_take (struct ets_heap *root, size_t nblocks, ets_block_t **blockp);
+
+//! Hold a free to a block owned by another thread until a whole group of them
+//! can be handed over at once; false if the thread no longer buffers.
+//! Thread-safe: 1
+static bool ets_rfb_defer (ets_block_t *block, void *object);
+//! Hand every buffered remote free over to its block.
+//! Thread-safe: 1
+static int ets_rfb_flush (ets_rfb_t *rfb);
+//! Return an object to its block, buffering the free if the block belongs to
+//! another thread.
+//! Thread-safe: 1
+static int ets_block_release_object (ets_block_t *block, void *object);
+//! Push a freed object onto its bin; false if the thread no longer caches.
+//! Thread-safe: OWNING
+static bool ets_tcache_push (ets_tcache_t *tc, size_t lkgi, void *object);
+//! Allocate from linkage `lkgi` of the thread's heap, and refill the bin with
+//! whatever else the head block can spare.
+//! Thread-safe: OWNING
+static int ets_tcache_refill (ets_tcache_t *tc, struct ets_heap *heap, size_t lkgi, void **object);
+//! Return every cached object to its block.
+//! Thread-safe: OWNING
+static void ets_tcache_flush (ets_tcache_t *tc);
+//! Make sure the calling thread has a heap, and with it a thread-exit hook.
+//! Thread-safe: 1
+static void ets_heap_ensure_local ();
 
 static int ets_lkg_init (ets_lkg_t *lkg, size_t lkgi, struct ets_heap *heap);
 //! Allocate object form linkage.
@@ -39,6 +109,10 @@ static int ets_lkg_alloc_object (ets_lkg_t *lkg, struct ets_heap *heap, void **o
 //! Request block from owning heap.
 //! Thread-safe: OWNING (LEAF)
 static int ets_lkg_req_block_from_heap (struct ets_heap *heap, size_t lkgi, ets_block_t **blockp);
+//! Pull blocks into a linkage until it has room for `count` more objects,
+//! without going through its head; see `reserve`.
+//! Thread-safe: OWNING
+static int ets_lkg_reserve (ets_lkg_t *lkg, struct ets_heap *heap, size_t count, int flags);
 //! Notify linkage that block became empty.
 //! Thread-safe: SINGLE
 //! Precondition: LL GL
@@ -47,42 +121,123 @@ static int ets_lkg_block_did_become_empty (ets_lkg_t *lkg, ets_block_t *block);
 //! Thread-safe: SINGLE
 //! Precondition: LL GL
 static int ets_lkg_block_did_become_partially_empty (ets_lkg_t *lkg, ets_block_t *block);
-//! Destroy heap
-//! Thread-safe: OWNING
-static int ets_lkg_evacuate_and_clean (ets_lkg_t *lkg);
 static int ets_heap_alloc_object (ets_heap_t *heap, void **object, size_t size);
 static int ets_heap_req_block_from_top (ets_heap_t *heap, size_t lkgi, ets_block_t **blockp);
 static int ets_heap_req_block_from_heap (ets_heap_t *heap, size_t lkgi, ets_block_t **blockp);
 static int ets_heap_req_block_from_ulkg (ets_lkg_t *lkg, size_t osize, ets_block_t **blockp);
 static int ets_heap_req_block_from_slkg (ets_lkg_t *lkg, ets_block_t **block);
 static int ets_heap_catch (ets_heap_t *heap, ets_block_t *block, size_t lkgi);
+//! Top the unsized linkage of `heap` up with `n` fresh blocks.
+//! Thread-safe: 1
+static int ets_heap_refill_ulkg (ets_heap_t *heap, size_t n);
+//! Free the blocks of the unsized linkage of `heap` past the first `keep`,
+//! from the tail; the head always stays.
+//! Thread-safe: 1
+static int ets_heap_trim_ulkg (ets_heap_t *heap, size_t keep);
 static int ets_heap_receive_applicant (ets_heap_t *heap, ets_block_t *block);
-static int ets_heap_evacuate_and_clean (ets_heap_t *heap);
+static int ets_heap_receive_applicants (ets_heap_t *heap, ets_block_t *first, ets_block_t *last, size_t n);
+
+static ets_page_map_t __ets_page_map = {
+    .pm_leaves = {},
+};
+
+static ets_arena_t __ets_arena = {
+    .a_regions = {},
+    .a_nregions = 0,
+    .a_hugetlb_failed = false,
+    .a_access = ETS_LOCK_INIT,
+};
+
+static ets_chunk_cache_t __ets_chunk_cache = {
+    .cc_first = nullptr,
+    .cc_last = nullptr,
+    .cc_nchunks = 0,
+    .cc_access = ETS_LOCK_INIT,
+};
+//! Decay period and cap of every chunk cache; see configure_chunk_cache.
+static uint64_t __ets_chunk_cache_decay_ns = ETS_CHUNK_CACHE_DECAY_MS * 1000000ul;
+static size_t __ets_chunk_cache_max_nchunks = ETS_CHUNK_CACHE_MAX_BYTES / ETS_CHUNK_SIZE;
+
+static ets_purged_list_t __ets_purged_list = {
+    .pl_first = nullptr,
+    .pl_ndirty = 0,
+    .pl_access = ETS_LOCK_INIT,
+};
 
-static ets_chunk_tracker_t __ets_chunk_tracker = {
-    .ct_first = nullptr,
-    .ct_access = PTHREAD_MUTEX_INITIALIZER,
+static ets_span_frontier_t __ets_span_frontier = {
+    .sf_chunk = nullptr,
+    .sf_next = 64,
+    .sf_ready = nullptr,
+    .sf_nready = 0,
+    .sf_target = 0,
+    .sf_ncarved = 0,
+    .sf_access = ETS_LOCK_INIT,
 };
 
-//! Allocate a new chunk.
+static ets_bgmm_t __ets_bgmm = {
+    .bg_lifted = nullptr,
+    .bg_nlifted = 0,
+    .bg_state = ETS_BGMM_STOPPED,
+    .bg_wake = 0,
+    .bg_purge_now = false,
+    .bg_interval_ns = ETS_BGMM_INTERVAL_MS * 1000000ul,
+    .bg_ncarved = 0,
+    .bg_carve_rate = 0,
+    .bg_thread = {},
+    .bg_access = ETS_LOCK_INIT,
+};
+//! Queue a block being lifted for the background thread, if it runs; the
+//! block stays locked until the thread catches it.
+//! Thread-safe: 1
+static bool ets_bgmm_defer_lift (ets_block_t *block);
+//! Catch every queued block.
+//! Thread-safe: 1
+static int ets_bgmm_drain ();
+//! Have the background thread look for work before its next tick.
+//! Thread-safe: 1
+static void ets_bgmm_wake ();
+//! Ready one more chunk ahead of the span frontier if it is short of its
+//! target, or give back those past it; true if it is still short, so that
+//! other work can go between chunks.
+//! Thread-safe: 1
+static bool ets_span_frontier_provision ();
+//! Release every chunk readied ahead of the span frontier, once the
+//! background thread is no longer there to hand them out or give them back.
+//! Thread-safe: 1
+static void ets_span_frontier_unprovision ();
+//! Purge the blocks left dirty `decay_ns` or more before `now`.
+//! Thread-safe: 1
+static int ets_bgmm_purge (uint64_t now, uint64_t decay_ns);
+
+//! Allocate a new chunk: the last one retired to the chunk cache, if there
+//! is any.
 //! Thread-safe: 1
 static int ets_chunk_alloc (ets_chunk_t **chunk);
-//! Bind a chunk to a heap and place it on the tracker.
-//! Thread-safe: OWNING
-static int ets_chunk_bind (ets_chunk_t *chunk, ets_heap_t *root, ets_chunk_tracker_t *tracker);
-/* motivation: ets_chunk_bind followed by ets_heap_req_block_from_ulkg does 0T
- * guarantee sucess (due to preemption).
- */
+//! Retire a chunk none of whose blocks are active any longer to `cache`, and
+//! release whatever the cache then holds past its decay period or its cap.
+//! Thread-safe: OWNING.
+static int ets_chunk_free (ets_chunk_t *chunk, ets_chunk_cache_t *cache);
+//! Give a chunk back to the arena, or unmap it.
+//! Thread-safe: OWNING.
+static int ets_chunk_release (ets_chunk_t *chunk);
+//! Release the chunks of `cache` retired `decay_ns` or more before `now`,
+//! and then the oldest until it holds no more than `max_nchunks`.
+//! Thread-safe: 1
+static int ets_chunk_cache_trim (ets_chunk_cache_t *cache, uint64_t now, uint64_t decay_ns, size_t max_nchunks);
+//! Take a run of `nblocks` purged blocks from a chunk on the purged list, if
+//! there is one; the head's header is not yet initialized.
+//! Thread-safe: 1
+static int ets_chunk_reuse_purged (size_t nblocks, ets_block_t **blockp);
 
-//! Bind a chunk to a heap, lift out one block, and place it on the tracker.
-//! If this function succeeds, it guarantees a usable block in lift, unlike
-//! [[ets_chunk_bind]], which does 0T guarantee a usable block upon success,
-//! whether due to preemption or error.
+//! Map a large region for an object of the given size.
+//! Thread-safe: 1
+static int ets_large_alloc_object (void **object, size_t osize, size_t align);
+//! Unmap a large region.
 //! Thread-safe: OWNING
-static int ets_chunk_reserve_and_bind (ets_chunk_t *chunk, ets_block_t **lift, ets_heap_t *root, ets_chunk_tracker_t *tracker);
-//! Free all remaining blocks in a chunk, and then the chunk itself.
-//! Thread-safe: OWNING.
-static int ets_chunk_free (ets_chunk_t *chunk);
+static int ets_large_dealloc_object (ets_large_t *large);
+//! Resize a large region, in place where possible.
+//! Thread-safe: OWNING
+static int ets_large_realloc_object (ets_large_t *large, void **object, size_t osize);
 
 #define LIKELY(x) __builtin_expect (!!(x), 1)
 #define UNLIKELY(x) __builtin_expect (!!(x), 0)
@@ -90,9 +245,21 @@ static int ets_chunk_free (ets_chunk_t *chunk);
 #define ETS_BLFL_HEAD 0x01
 #define ETS_BLFL_IN_THEATRE 0x02
 #define ETS_BLFL_ROH 0x04
+//! Set while an empty block is on its way out of its linkage; see
+//! `ets_block_has_free`.
+#define ETS_BLFL_LIFTING 0x08
 #define ETS_CHECK_PROMOTION_FAILURES 0
 #define ETS_FEATURE_CHUNKS_USE_MEMALIGN 0
 #define ETS_FEATURE_CHUNKS_USE_MACH_MAP 0
+#define ETS_FEATURE_REMOTE_FREE_BUFFER 1
+#define ETS_FEATURE_LAZY_CARVING 1
+#define ETS_FEATURE_BLOCK_COLORING 1
+//! Purge with MADV_FREE where available: cheaper, but the pages stay in RSS
+//! until the kernel wants them back.
+#define ETS_FEATURE_LAZY_PURGE 0
+//! Chunks on the purged list looked at for a reuse.
+#define ETS_PURGED_REUSE_SCAN 16
+#define ETS_FEATURE_CHUNK_ARENA 1
 // Weird version of x!=0 && x!=1
 #define ETS_ISERR(x) (!!((x) & ~1))
 #define ETS_PAGE_SIZE 0x1000L
@@ -107,6 +274,8 @@ static int ets_chunk_free (ets_chunk_t *chunk);
 #define E_EMPTY 5
 #define E_LKG_SPOILED_PROMOTEE 6
 #define E_NXLKG 7
+#define E_PURGE_FAILED 8
+#define E_FOREIGN 9
 
 #define ETS_TID_NULL 0L
 static _Thread_local uint64_t __ETS_tid = ETS_TID_NULL;
@@ -214,83 +383,31 @@ static inline void _ETS_log (const char *s, ...)
     #define CTXDOWN(...)
 #endif
 
-static int ets_mutex_lock (pthread_mutex_t *mutex)
+static int ets_mutex_lock (ets_lock_t *mutex)
 {
     CTX ("\x1b[31mLOCKING\x1b[0m %p", mutex)
-    return pthread_mutex_lock (mutex);
+    ets_lock_acquire (mutex);
+    return 0;
 }
-static int ets_mutex_unlock (pthread_mutex_t *mutex)
+static int ets_mutex_unlock (ets_lock_t *mutex)
 {
     CTX ("\x1b[33mUNLOCKING\x1b[0m %p", mutex)
-    return pthread_mutex_unlock (mutex);
+    ets_lock_release (mutex);
+    return 0;
 }
 
 #ifdef __cplusplus
 extern "C"
 {
-    size_t ets_rlup_sli (size_t lkgi);
-    size_t ets_lup_sli (size_t osize);
     bool ets_should_lkg_recv_block (ets_heap_t *heap, ets_lkg_t *lkg);
     bool ets_should_lkg_lift_block (ets_lkg_t *lkg, ets_block_t *block);
 }
 #else
-extern size_t ets_rlup_sli (size_t lkgi);
-extern size_t ets_lup_sli (size_t osize);
 extern bool ets_should_lkg_recv_block (ets_heap_t *heap, ets_lkg_t *lkg);
 extern bool ets_should_lkg_lift_block (ets_lkg_t *lkg, ets_block_t *block);
 #endif
 /* SECTION: TESTING */
 
-size_t ets_rlup_sli (size_t lkgi)
-{
-    --lkgi;
-    return (16ul << (lkgi >> 1)) + ((lkgi & 1) << ((lkgi >> 1) + 3));
-}
-
-//#if !USE_EXTERN_LUPSLI
-#if __x86_64__
-size_t ets_lup_sli (size_t osize)
-{
-    __asm volatile(
-        "movq %rdi, %r8\n\t"
-        "bsrq %rdi, %rax\n\t"
-        "movq %rax, %rdx\n\t"
-        "shl $1, %rax\n\t"
-        "xorq %rsi, %rsi\n\t"
-        "btrq %rdx, %rdi\n\t"
-        "setnc %sil\n\t"
-        "decq %rdx\n\t"
-        "btrq %rdx, %rdi\n\t"
-        "setc %r9b\n\t"
-        "xorq %rcx, %rcx\n\t"
-        "testq %rdi, %rdi\n\t"
-        "setnz %cl\n\t"
-        "andb %r9b, %cl\n\t"
-        "subq %rsi, %rax\n\t"
-        "addq %rcx, %rax\n\t"
-        "subq $6, %rax\n\t"
-        "movq $1, %rsi\n\t"
-        "cmpq $16, %r8\n\t"
-        "cmovleq %rsi, %rax\n\t"
-        "pop %rbp\n\t"
-        "retq\n\t");
-    __builtin_unreachable ();
-}
-#else
-size_t ets_lup_sli (size_t osize)
-{
-    if (osize <= 16) return 1;
-    size_t __nlz;
-    size_t __res = (__nlz = 63 - __builtin_clzl (osize))
-                       ? (2 * __nlz) - !(~(1 << __nlz) & osize)
-                             + ((1 << (__nlz - 1)) & osize
-                                && ~(3 << (__nlz - 1)) & osize)
-                             - 7
-                       : 0;
-    return __res + 1;
-}
-#endif
-
 #define ETS_LKG_LIFT_BOUNDARY_NORMAL_SLKG 16
 #define ETS_LKG_LIFT_BOUNDARY_NORMAL_ULKG 24
 #define ETS_LKG_LIFT_BOUNDARY_ROOT_SLKG 32
@@ -316,6 +433,9 @@ bool ets_should_lkg_lift_block (ets_lkg_t *lkg, ets_block_t *block)
         fprintf (stderr, "lift event occurred in ulkg.");
         return 0;
     }
+    if (lkg->l_nblocks <= lkg->l_nreserved) {
+        return 0;
+    }
     if (lkg->l_owning_heap->h_owning_heap == nullptr) {
         return lkg->l_index == 0
                    ? lkg->l_nblocks >= ETS_LKG_LIFT_BOUNDARY_ROOT_ULKG
@@ -395,7 +515,7 @@ static int ets_pages_alloc_aligned (void **memory, size_t size, size_t align)
         (*memory) = (void *)vm_addr;
     }
 #else
-    const size_t mapped_size = (align << 1) - 0x1000;
+    const size_t mapped_size = size + align - 0x1000;
     /* afaict, MAP_ANONYMOUS is more standard than MAP_ANON */
     void *swath = mmap (nullptr, mapped_size, PROT_READ | PROT_WRITE,
                         MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
@@ -441,6 +561,352 @@ static int ets_pages_free (void *memory, size_t size)
     return E_OK;
 }
 
+//! Hand the physical memory behind a range back to the kernel, keeping the
+//! mapping. MADV_DONTNEED drops the pages at once; with
+//! ETS_FEATURE_LAZY_PURGE, MADV_FREE lets the kernel take them back lazily,
+//! when it comes under pressure. Either way, the range reads as garbage or
+//! zeroes afterwards.
+static int ets_pages_purge (void *memory, size_t size)
+{
+#if ETS_FEATURE_LAZY_PURGE && defined MADV_FREE
+    static bool madv_free_unsupported = false;
+    if (!__atomic_load_n (&madv_free_unsupported, __ATOMIC_RELAXED)) {
+        if (0 == madvise (memory, size, MADV_FREE)) {
+            CTX ("ets_pages_purge: MADV_FREE succeeded at %p for size=%p", memory, size);
+            return E_OK;
+        }
+        if (EINVAL != errno) {
+            CTX ("ets_pages_purge: MADV_FREE failed at %p for size=%p with error code %i (%s)",
+                 memory, size, errno, strerror (errno));
+            return E_PURGE_FAILED;
+        }
+        /* kernels before 4.5 */
+        __atomic_store_n (&madv_free_unsupported, true, __ATOMIC_RELAXED);
+    }
+#endif
+    if (-1 == madvise (memory, size, MADV_DONTNEED)) {
+        CTX ("ets_pages_purge: MADV_DONTNEED failed at %p for size=%p with error code %i (%s)",
+             memory, size, errno, strerror (errno));
+        return E_PURGE_FAILED;
+    }
+    CTX ("ets_pages_purge: MADV_DONTNEED succeeded at %p for size=%p", memory, size);
+    return E_OK;
+}
+
+#if ETS_FEATURE_CHUNK_HUGE_PAGES == ETS_CHUNK_HUGE_PAGES_HUGETLB && defined MAP_HUGETLB
+//! `ets_pages_purge` for hugetlb pages, which MADV_FREE does not apply to,
+//! and MADV_DONTNEED only from Linux 5.18 on. Where it fails, mapping fresh
+//! hugetlb pages over the range drops the old ones all the same; should the
+//! pool not cover those, small pages take their place, so that the range
+//! never goes unmapped.
+static int ets_pages_purge_hugetlb (void *memory, size_t size)
+{
+    static bool madv_dontneed_unsupported = false;
+    if (!__atomic_load_n (&madv_dontneed_unsupported, __ATOMIC_RELAXED)) {
+        if (0 == madvise (memory, size, MADV_DONTNEED)) {
+            CTX ("ets_pages_purge_hugetlb: MADV_DONTNEED succeeded at %p for size=%p", memory, size);
+            return E_OK;
+        }
+        if (EINVAL != errno) {
+            CTX ("ets_pages_purge_hugetlb: MADV_DONTNEED failed at %p for size=%p with error code %i (%s)",
+                 memory, size, errno, strerror (errno));
+            return E_PURGE_FAILED;
+        }
+        /* kernels before 5.18 */
+        __atomic_store_n (&madv_dontneed_unsupported, true, __ATOMIC_RELAXED);
+    }
+    const int prot = PROT_READ | PROT_WRITE;
+    if (MAP_FAILED != mmap (memory, size, prot, MAP_ANONYMOUS | MAP_PRIVATE | MAP_FIXED | MAP_HUGETLB, -1, 0)
+        || MAP_FAILED != mmap (memory, size, prot, MAP_ANONYMOUS | MAP_PRIVATE | MAP_FIXED | MAP_NORESERVE, -1, 0)) {
+        CTX ("ets_pages_purge_hugetlb: remapped %p for size=%p", memory, size);
+        return E_OK;
+    }
+    CTX ("ets_pages_purge_hugetlb: remapping %p for size=%p failed with error code %i (%s)",
+         memory, size, errno, strerror (errno));
+    return E_PURGE_FAILED;
+}
+
+#endif
+//! Fault a range in for writing ahead of its use: with MADV_POPULATE_WRITE
+//! where available (Linux 5.14), otherwise with a write to each page that
+//! leaves its contents as they are.
+static int ets_pages_prefault (void *memory, size_t size)
+{
+#if defined MADV_POPULATE_WRITE
+    static bool madv_populate_unsupported = false;
+    if (!__atomic_load_n (&madv_populate_unsupported, __ATOMIC_RELAXED)) {
+        if (0 == madvise (memory, size, MADV_POPULATE_WRITE)) {
+            CTX ("ets_pages_prefault: MADV_POPULATE_WRITE succeeded at %p for size=%p", memory, size);
+            return E_OK;
+        }
+        if (EINVAL != errno) {
+            CTX ("ets_pages_prefault: MADV_POPULATE_WRITE failed at %p for size=%p with error code %i (%s)",
+                 memory, size, errno, strerror (errno));
+            return E_FAIL;
+        }
+        __atomic_store_n (&madv_populate_unsupported, true, __ATOMIC_RELAXED);
+    }
+#endif
+    for (size_t offset = 0; offset < size; offset += ETS_PAGE_SIZE) {
+        __atomic_fetch_or ((uint8_t *)memory + offset, 0, __ATOMIC_RELAXED);
+    }
+    return E_OK;
+}
+
+//! Whether `memory` lies in address space reserved by the arena: a bounds
+//! check per region, with no lock.
+//! Thread-safe: 1
+static inline bool ets_arena_contains (ets_arena_t *arena, const void *memory)
+{
+    const size_t nregions = __atomic_load_n (&arena->a_nregions, __ATOMIC_ACQUIRE);
+    for (size_t i = 0; i < nregions; ++i) {
+        if ((uintptr_t)memory - (uintptr_t)arena->a_regions[i].ar_base < ETS_ARENA_STEP) {
+            return true;
+        }
+    }
+    return false;
+}
+
+//! Reserve another ETS_ARENA_STEP bytes of address space, right after the
+//! last region if the kernel lets us. The hugetlb pool, if so configured,
+//! only comes in as the region is committed.
+//! Thread-safe: LOCKED
+static int ets_arena_reserve (ets_arena_t *arena)
+{
+    if (arena->a_nregions == ETS_ARENA_MAX_REGIONS) {
+        return E_MAP_FAILED;
+    }
+    const int prot = PROT_NONE;
+#if defined MAP_NORESERVE
+    const int flags = MAP_ANONYMOUS | MAP_PRIVATE | MAP_NORESERVE;
+#else
+    const int flags = MAP_ANONYMOUS | MAP_PRIVATE;
+#endif
+    uint8_t *base = nullptr;
+#if defined MAP_FIXED_NOREPLACE
+    if (!base && arena->a_nregions) {
+        uint8_t *const hint = arena->a_regions[arena->a_nregions - 1].ar_base + ETS_ARENA_STEP;
+        void *swath = mmap (hint, ETS_ARENA_STEP, prot, flags | MAP_FIXED_NOREPLACE, -1, 0);
+        if (swath == hint) {
+            base = hint;
+        } else if (swath != MAP_FAILED) {
+            /* kernels before 4.17 take the flag as a mere hint */
+            munmap (swath, ETS_ARENA_STEP);
+        }
+    }
+#endif
+    if (!base) {
+        const size_t mapped_size = ETS_ARENA_STEP + ETS_ARENA_ALIGN - ETS_PAGE_SIZE;
+        void *swath = mmap (nullptr, mapped_size, prot, flags, -1, 0);
+        if (swath == MAP_FAILED) {
+            CTX ("ets_arena_reserve: mmap failed with error code %i (%s)", errno, strerror (errno));
+            return E_MAP_FAILED;
+        }
+        const uintptr_t addr = ((uintptr_t)swath + ETS_ARENA_ALIGN - 1) & ~(ETS_ARENA_ALIGN - 1);
+        if (addr != (uintptr_t)swath) {
+            munmap (swath, addr - (uintptr_t)swath);
+        }
+        const uintptr_t end = (uintptr_t)swath + mapped_size;
+        if (end != addr + ETS_ARENA_STEP) {
+            munmap ((void *)(addr + ETS_ARENA_STEP), end - (addr + ETS_ARENA_STEP));
+        }
+        base = (uint8_t *)addr;
+    }
+
+    ets_arena_region_t *const region = &arena->a_regions[arena->a_nregions];
+    region->ar_base = base;
+    region->ar_nhugetlb = 0;
+    region->ar_next = 0;
+    region->ar_committed = 0;
+    memset (region->ar_free, 0, sizeof region->ar_free);
+    region->ar_nfree = 0;
+    __atomic_store_n (&arena->a_nregions, arena->a_nregions + 1, __ATOMIC_RELEASE);
+    CTX ("ets_arena_reserve: region #%zu at %p", arena->a_nregions - 1, base)
+    return E_OK;
+}
+
+//! Commit the next stretch of the last region: a huge page from the hugetlb
+//! pool if so configured, and while it lasts, otherwise up to
+//! ETS_ARENA_COMMIT_STEP bytes, advised MADV_HUGEPAGE with huge pages.
+//! Thread-safe: LOCKED
+static int ets_arena_commit (ets_arena_t *arena, ets_arena_region_t *region)
+{
+    uint8_t *const from = region->ar_base + region->ar_committed * ETS_CHUNK_SIZE;
+#if ETS_FEATURE_CHUNK_HUGE_PAGES == ETS_CHUNK_HUGE_PAGES_HUGETLB && defined MAP_HUGETLB
+    if (!arena->a_hugetlb_failed) {
+        /* a page at a time, and without MAP_NORESERVE, so that pool pages
+         * are set aside as they come into use rather than a region's worth
+         * at once, yet never found missing, with a SIGBUS, at a fault */
+        if (MAP_FAILED != mmap (from, ETS_HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                                MAP_ANONYMOUS | MAP_PRIVATE | MAP_FIXED | MAP_HUGETLB, -1, 0)) {
+            region->ar_committed += ETS_HUGE_PAGE_NCHUNKS;
+            region->ar_nhugetlb = region->ar_committed;
+            return E_OK;
+        }
+        CTX ("ets_arena_commit: hugetlb mmap failed at %p with error code %i (%s); falling back on THP",
+             from, errno, strerror (errno));
+        arena->a_hugetlb_failed = true;
+        /* the failed mapping may have taken the reserved one with it */
+        if (MAP_FAILED == mmap (from, ETS_HUGE_PAGE_SIZE, PROT_NONE,
+                                MAP_ANONYMOUS | MAP_PRIVATE | MAP_FIXED | MAP_NORESERVE, -1, 0)) {
+            CTX ("ets_arena_commit: mmap failed at %p with error code %i (%s)", from, errno, strerror (errno));
+            return E_MAP_FAILED;
+        }
+    }
+#endif
+    /* committing a huge page at a time may have left less than a step */
+    size_t nchunks = ETS_ARENA_COMMIT_STEP / ETS_CHUNK_SIZE;
+    if (nchunks > ETS_ARENA_STEP_NCHUNKS - region->ar_committed) {
+        nchunks = ETS_ARENA_STEP_NCHUNKS - region->ar_committed;
+    }
+    if (-1 == mprotect (from, nchunks * ETS_CHUNK_SIZE, PROT_READ | PROT_WRITE)) {
+        CTX ("ets_arena_commit: mprotect failed at %p with error code %i (%s)", from, errno, strerror (errno));
+        return E_MAP_FAILED;
+    }
+#if ETS_FEATURE_CHUNK_HUGE_PAGES && defined MADV_HUGEPAGE
+    /* without THP, the chunks just come in small pages */
+    if (-1 == madvise (from, nchunks * ETS_CHUNK_SIZE, MADV_HUGEPAGE)) {
+        CTX ("ets_arena_commit: MADV_HUGEPAGE failed at %p with error code %i (%s)", from, errno, strerror (errno));
+    }
+#endif
+    region->ar_committed += nchunks;
+    return E_OK;
+}
+
+//! Hand out a chunk from the arena: a freed one if there is any, otherwise
+//! the next one from the bump of the last region, committing (and reserving)
+//! more as needed.
+//! Thread-safe: 1
+static int ets_arena_alloc_chunk (ets_arena_t *arena, void **chunkp)
+{
+    ets_mutex_lock (&arena->a_access);
+    for (size_t i = 0; i < arena->a_nregions; ++i) {
+        ets_arena_region_t *const region = &arena->a_regions[i];
+        if (!region->ar_nfree) continue;
+        for (size_t w = 0; w < ETS_ARENA_STEP_NCHUNKS / 64; ++w) {
+            if (region->ar_free[w]) {
+                const size_t bit = __builtin_ctzll (region->ar_free[w]);
+                region->ar_free[w] &= region->ar_free[w] - 1;
+                --region->ar_nfree;
+                ets_mutex_unlock (&arena->a_access);
+                (*chunkp) = region->ar_base + (w * 64 + bit) * ETS_CHUNK_SIZE;
+                return E_OK;
+            }
+        }
+    }
+
+    if (!arena->a_nregions || ETS_ARENA_STEP_NCHUNKS == arena->a_regions[arena->a_nregions - 1].ar_next) {
+        const int r = ets_arena_reserve (arena);
+        if (E_OK != r) {
+            ets_mutex_unlock (&arena->a_access);
+            return r;
+        }
+    }
+    ets_arena_region_t *const region = &arena->a_regions[arena->a_nregions - 1];
+    if (region->ar_next == region->ar_committed) {
+        const int r = ets_arena_commit (arena, region);
+        if (E_OK != r) {
+            ets_mutex_unlock (&arena->a_access);
+            return r;
+        }
+    }
+    (*chunkp) = region->ar_base + region->ar_next++ * ETS_CHUNK_SIZE;
+    ets_mutex_unlock (&arena->a_access);
+    return E_OK;
+}
+
+//! Take a chunk back: its memory goes back to the kernel, its address space
+//! stays committed, for the next chunk to come. With huge pages, the memory
+//! only goes back once every chunk of its huge page is free.
+//! Thread-safe: 1
+static int ets_arena_free_chunk (ets_arena_t *arena, void *chunk)
+{
+#if ETS_FEATURE_CHUNK_HUGE_PAGES
+    int r = E_OK;
+#else
+    const int r = ets_pages_purge (chunk, ETS_CHUNK_SIZE);
+#endif
+    ets_mutex_lock (&arena->a_access);
+    for (size_t i = 0; i < arena->a_nregions; ++i) {
+        ets_arena_region_t *const region = &arena->a_regions[i];
+        const size_t chunk_no = ((uintptr_t)chunk - (uintptr_t)region->ar_base) / ETS_CHUNK_SIZE;
+        if (chunk_no < ETS_ARENA_STEP_NCHUNKS) {
+            const uint64_t bit = 1ull << (chunk_no % 64);
+#if ETS_FEATURE_CHUNK_HUGE_PAGES
+            const size_t page_no = chunk_no & ~(ETS_HUGE_PAGE_NCHUNKS - 1);
+            const uint64_t page_bits = ((1ull << ETS_HUGE_PAGE_NCHUNKS) - 1) << (page_no % 64);
+            const uint64_t buddy_bits = page_bits & ~bit;
+            uint64_t *const word = &region->ar_free[chunk_no / 64];
+            if ((*word & buddy_bits) == buddy_bits) {
+                /* the buddies are claimed while the page is purged, so that
+                 * none of them can be handed out from under the purge */
+                *word &= ~buddy_bits;
+                region->ar_nfree -= ETS_HUGE_PAGE_NCHUNKS - 1;
+                uint8_t *const page = region->ar_base + page_no * ETS_CHUNK_SIZE;
+#if ETS_FEATURE_CHUNK_HUGE_PAGES == ETS_CHUNK_HUGE_PAGES_HUGETLB && defined MAP_HUGETLB
+                const bool hugetlb = page_no < region->ar_nhugetlb;
+                ets_mutex_unlock (&arena->a_access);
+                r = hugetlb ? ets_pages_purge_hugetlb (page, ETS_HUGE_PAGE_SIZE)
+                            : ets_pages_purge (page, ETS_HUGE_PAGE_SIZE);
+#else
+                ets_mutex_unlock (&arena->a_access);
+                r = ets_pages_purge (page, ETS_HUGE_PAGE_SIZE);
+#endif
+                ets_mutex_lock (&arena->a_access);
+                *word |= page_bits;
+                region->ar_nfree += ETS_HUGE_PAGE_NCHUNKS;
+                break;
+            }
+#endif
+            region->ar_free[chunk_no / 64] |= bit;
+            ++region->ar_nfree;
+            break;
+        }
+    }
+    ets_mutex_unlock (&arena->a_access);
+    return r;
+}
+
+/* SECTION: PAGE MAP */
+
+//! Point the entries of the `nchunks` chunks from `memory` on at `entry`,
+//! mapping whichever leaves they need (none, to clear them). A leaf that
+//! loses the race to be installed is unmapped again.
+//! Thread-safe: 1 (per range)
+static int ets_pmap_set (ets_page_map_t *pm, const void *memory, size_t nchunks, uintptr_t entry)
+{
+    const uintptr_t first = (uintptr_t)memory >> ETS_PMAP_SHIFT;
+    if ((first + nchunks) >> ETS_PMAP_KEY_BITS) {
+        CTX ("ets_pmap_set: %p lies past the page map", memory)
+        return E_FAIL;
+    }
+    for (uintptr_t key = first; key < first + nchunks; ++key) {
+        uintptr_t **const slot = &pm->pm_leaves[key >> ETS_PMAP_LEAF_BITS];
+        uintptr_t *leaf = __atomic_load_n (slot, __ATOMIC_ACQUIRE);
+        if (UNLIKELY (!leaf)) {
+            /* nothing to clear */
+            if (ETS_PMAP_NONE == entry) continue;
+            uintptr_t *fresh;
+            const int r = ets_pages_alloc ((void **)&fresh, sizeof (uintptr_t) << ETS_PMAP_LEAF_BITS);
+            if (E_OK != r) return r;
+            if (__atomic_compare_exchange_n (slot, &leaf, fresh, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                leaf = fresh;
+            } else {
+                ets_pages_free (fresh, sizeof (uintptr_t) << ETS_PMAP_LEAF_BITS);
+            }
+        }
+        __atomic_store_n (&leaf[key & ((1L << ETS_PMAP_LEAF_BITS) - 1)], entry, __ATOMIC_RELEASE);
+    }
+    return E_OK;
+}
+
+//! Number of chunks the page map has entries for in a large region of
+//! `msize` bytes.
+static inline size_t ets_pmap_large_nchunks (size_t msize)
+{
+    return (msize + ETS_CHUNK_SIZE - 1) / ETS_CHUNK_SIZE;
+}
+
 /* SECTION: TID */
 
 struct _ETS_page_vect
@@ -469,7 +935,7 @@ static int _ets_page_vect_push (struct _ETS_page_vect *pv, void *obj)
             new_map_size = pv->pv_size << 1;
         }
         void *old_pages = pv->pv_pages;
-        pv->pv_pages = mmap (nullptr, new_map_size, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_SHARED,
+        pv->pv_pages = mmap (nullptr, new_map_size, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE,
                              -1, 0);
         if (MAP_FAILED == pv->pv_pages) {
             fprintf (stderr, "could not grow page_vect: map failed\n");
@@ -492,15 +958,14 @@ static int _ets_page_vect_pop (struct _ETS_page_vect *pv, void *obj)
     size_t current_offset = (pv->pv_nobjs - 1) * pv->pv_osize;
     --pv->pv_nobjs;
     memcpy (obj, (char *)pv->pv_pages + current_offset, pv->pv_osize);
-    if (current_offset & ~(ETS_PAGE_SIZE - 1)) {
-        munmap ((char *)pv->pv_pages + current_offset, ETS_PAGE_SIZE);
-    }
+    /* pages are kept around: `_ets_page_vect_push` expects the whole of
+     * pv_size to still be mapped */
     return E_OK;
 }
 
 static uint64_t __ETS_tid_vcounter = ETS_TID_NULL;
 static struct _ETS_page_vect __ETS_tid_recyls = _ETS_PAGE_VECT_INIT (sizeof (uint64_t));
-static pthread_mutex_t __ETS_tid_recyaccess = PTHREAD_MUTEX_INITIALIZER;
+static ets_lock_t __ETS_tid_recyaccess = ETS_LOCK_INIT;
 static pthread_once_t __ETS_tid_recyaccessinit_once = PTHREAD_ONCE_INIT;
 
 #include <stdio.h>
@@ -518,7 +983,7 @@ static uint64_t ets_tid_next_monotonic ()
 #if ETS_TID_TRY_RECYCLE
 static void __ETS_init_recyaccess (void)
 {
-    pthread_mutex_init (&__ETS_tid_recyaccess, nullptr);
+    ets_lock_init (&__ETS_tid_recyaccess);
 }
 #endif
 
@@ -585,12 +1050,21 @@ static int ets_lkg_block_did_become_empty (ets_lkg_t *lkg, ets_block_t *block)
     if (!ets_should_lkg_lift_block (lkg, block)) {
         CTXDOWN ("decided not to lift block (length = %zu)",
                  __atomic_load_n (&lkg->l_nblocks, __ATOMIC_SEQ_CST));
+        /* blocks too small to ever pass through the partially-empty state
+         * (single-object spans) would otherwise stay left of head forever */
+        if (!(ETS_BLFL_ROH & __atomic_load_n (&block->b_flags, __ATOMIC_SEQ_CST))) {
+            return ets_lkg_block_did_become_partially_empty (lkg, block);
+        }
         ets_mutex_unlock (&block->b_access);
         ets_mutex_unlock (&lkg->l_access);
         return E_OK;
     }
 
     void *heap = ets_get_heap_for_lkg (lkg);
+    /* cauterized blocks are no longer counted */
+    if (block->b_prev != nullptr || block->b_next != nullptr) {
+        --lkg->l_nblocks;
+    }
     if (block->b_prev != nullptr) {
         block->b_prev->b_next = block->b_next;
         //block->b_prev = nullptr;
@@ -603,9 +1077,12 @@ static int ets_lkg_block_did_become_empty (ets_lkg_t *lkg, ets_block_t *block)
     __atomic_store_n (&block->b_owning_tid, ETS_TID_NULL, __ATOMIC_SEQ_CST);
     __atomic_and_fetch (&block->b_flags, ~ETS_BLFL_IN_THEATRE, __ATOMIC_SEQ_CST);
 
-    --lkg->l_nblocks;
     ets_mutex_unlock (&lkg->l_access);
 
+    if (ets_bgmm_defer_lift (block)) {
+        CTXDOWN ("lift deferred to the background thread");
+        return E_OK;
+    }
     const int r = ets_heap_catch ((ets_heap_t *)heap, block, lkg->l_index);
     CTXDOWN ("ets_heap_catch returned %i", r);
     return r;
@@ -616,20 +1093,28 @@ static int ets_heap_receive_applicant (ets_heap_t *heap, ets_block_t *block)
 #if ETS_LOG_CHUNK_ENUM
     CTX ("ets_heap_receive_applicant called with heap=%p, block=%p", heap, block);
 #endif
+    __atomic_store_n (&block->b_owning_lkg, &heap->h_lkgs[0], __ATOMIC_SEQ_CST);
+    __atomic_store_n (&block->b_owning_tid, ETS_TID_NULL, __ATOMIC_SEQ_CST);
+    return ets_heap_receive_applicants (heap, block, block, 1);
+}
+
+//! Splice a run of `n` blocks, already linked from `first` to `last` and
+//! owned by the unsized linkage, in front of its head in one go.
+static int ets_heap_receive_applicants (ets_heap_t *heap, ets_block_t *first, ets_block_t *last, size_t n)
+{
     ets_lkg_t *recv_lkg = &heap->h_lkgs[0];
     ets_mutex_lock (&recv_lkg->l_access);
     ets_block_t *head_cache = __atomic_load_n (&recv_lkg->l_active, __ATOMIC_SEQ_CST);
-    block->b_next = head_cache;
-    if (block->b_next) {
-        block->b_prev = head_cache->b_prev;
-        block->b_next->b_prev = block;
-        if (block->b_prev)
-            block->b_prev->b_next = block;
+    last->b_next = head_cache;
+    if (head_cache) {
+        first->b_prev = head_cache->b_prev;
+        head_cache->b_prev = last;
+        if (first->b_prev)
+            first->b_prev->b_next = first;
     } else
-        block->b_prev = nullptr;
-    __atomic_store_n (&block->b_owning_lkg, recv_lkg, __ATOMIC_SEQ_CST);
-    __atomic_store_n (&block->b_owning_tid, ETS_TID_NULL, __ATOMIC_SEQ_CST);
-    __atomic_store_n (&recv_lkg->l_active, block, __ATOMIC_SEQ_CST);
+        first->b_prev = nullptr;
+    __atomic_store_n (&recv_lkg->l_active, first, __ATOMIC_SEQ_CST);
+    recv_lkg->l_nblocks += n;
     ets_mutex_unlock (&recv_lkg->l_access);
 
     return E_OK;
@@ -651,6 +1136,7 @@ static int ets_lkg_receive_block (ets_lkg_t *recv_lkg, ets_block_t *block)
     __atomic_store_n (&block->b_owning_lkg, recv_lkg, __ATOMIC_SEQ_CST);
     __atomic_store_n (&block->b_owning_tid, ETS_TID_NULL, __ATOMIC_SEQ_CST);
     __atomic_store_n (&recv_lkg->l_active, block, __ATOMIC_SEQ_CST);
+    ++recv_lkg->l_nblocks;
     ets_mutex_unlock (&block->b_access);
     ets_mutex_unlock (&recv_lkg->l_access);
 
@@ -677,7 +1163,9 @@ static int ets_heap_catch (ets_heap_t *heap, ets_block_t *block, size_t lkgi)
         return r;
     }
 
-    if (!__atomic_load_n (&block->b_acnt, __ATOMIC_SEQ_CST)) {
+    /* spans are never split back up, so they stay in sized linkages until
+     * they reach the top */
+    if (!__atomic_load_n (&block->b_acnt, __ATOMIC_SEQ_CST) && 1 == block->b_nblocks) {
         LOG ("block is empty; promoting to unsized linkage");
         recv_lkg = &heap->h_lkgs[0];
     }
@@ -692,50 +1180,74 @@ static int ets_heap_catch (ets_heap_t *heap, ets_block_t *block, size_t lkgi)
     }
 }
 
-static int ets_lkg_evacuate_and_clean (ets_lkg_t *lkg)
+static int ets_heap_refill_ulkg (ets_heap_t *heap, size_t n)
 {
-    CTXUP ("EVACUATING LINKAGE %p", lkg);
-    ets_mutex_lock (&lkg->l_access);
-    ets_heap_t *heap = lkg->l_owning_heap;
-    ets_block_t *head = __atomic_exchange_n (&lkg->l_active, nullptr, __ATOMIC_SEQ_CST);
-
-    VAR (int evac_block_count = 0;)
-
-    const size_t lkgi = lkg->l_index;
-    if (head) {
-        ets_block_t *block = head;
-        while (block) {
-            block = block->b_next;
-            ets_mutex_lock (&block->b_access);
-            __atomic_and_fetch (&block->b_flags, ~(ETS_BLFL_IN_THEATRE | ETS_BLFL_HEAD), __ATOMIC_SEQ_CST);
+    CTXUP ("ets_heap_refill_ulkg called with heap=%p, n=%zu", heap, n)
+    ets_heap_t *root = heap;
+    while (root->h_owning_heap) {
+        root = root->h_owning_heap;
+    }
+
+    /* link the run up privately, then splice it in under a single lock */
+    ets_block_t *first = nullptr, *last = nullptr;
+    size_t n_taken = 0;
+    int r = E_OK;
+    for (; n_taken < n; ++n_taken) {
+        ets_block_t *block;
+        r = ets_span_take (root, 1, &block);
+        if (E_OK != r) break;
+        ets_block_init (block);
+        block->b_owning_lkg = &heap->h_lkgs[0];
+        block->b_prev = last;
+        if (last)
+            last->b_next = block;
+        else
+            first = block;
+        last = block;
+    }
+    if (n_taken) {
+        ets_heap_receive_applicants (heap, first, last, n_taken);
+    }
+    CTXDOWN ("added %zu/%zu blocks, status=%i", n_taken, n, r)
+    return r;
+}
 
-            const int r = ets_heap_catch (heap, block, lkgi);
-            LOG ("evacuation of block #%i returned with status %i", evac_block_count++, r);
-        }
-        block = head;
-        while (block) {
-            ets_mutex_lock (&block->b_access);
-            __atomic_and_fetch (&block->b_flags, ~(ETS_BLFL_IN_THEATRE | ETS_BLFL_HEAD), __ATOMIC_SEQ_CST);
+static int ets_heap_trim_ulkg (ets_heap_t *heap, size_t keep)
+{
+    ets_lkg_t *const lkg = &heap->h_lkgs[0];
+    if (__atomic_load_n (&lkg->l_nblocks, __ATOMIC_RELAXED) <= keep) {
+        return E_OK;
+    }
+    CTXUP ("ets_heap_trim_ulkg called with heap=%p, keep=%zu", heap, keep)
 
-            const int r = ets_heap_catch (heap, block, lkgi);
-            LOG ("evacuation of block #%i returned with status %i", evac_block_count++, r);
-            block = block->b_prev;
-        }
+    /* unhook the excess under the lock, and free it outside; blocks are taken
+     * from the head, so the coldest are at the tail */
+    ets_block_t *trimmed = nullptr;
+    size_t n_trimmed = 0;
+    ets_mutex_lock (&lkg->l_access);
+    ets_block_t *const head_cache = __atomic_load_n (&lkg->l_active, __ATOMIC_SEQ_CST);
+    ets_block_t *tail = head_cache;
+    while (tail && tail->b_next) {
+        tail = tail->b_next;
+    }
+    while (lkg->l_nblocks > keep && tail != head_cache) {
+        ets_block_t *const block = tail;
+        tail = block->b_prev;
+        ets_mutex_lock (&block->b_access);
+        tail->b_next = nullptr;
+        --lkg->l_nblocks;
+        block->b_next = trimmed;
+        trimmed = block;
+        ++n_trimmed;
     }
     ets_mutex_unlock (&lkg->l_access);
-    pthread_mutex_destroy (&lkg->l_access);
-    CTXDOWN ("FINISHED EVACUATING LINKAGE");
 
-    return E_OK;
-}
-
-static int ets_heap_evacuate_and_clean (ets_heap_t *heap)
-{
-    CTXUP ("EVACUATING HEAP %p", heap);
-    for (size_t i = 0; i < heap->h_nlkgs; ++i) {
-        ets_lkg_evacuate_and_clean (&heap->h_lkgs[i]);
+    while (trimmed) {
+        ets_block_t *const next = trimmed->b_next;
+        ets_block_free (trimmed);
+        trimmed = next;
     }
-    CTXDOWN ("FINISHED EVACUATING HEAP");
+    CTXDOWN ("freed %zu blocks", n_trimmed)
     return E_OK;
 }
 
@@ -746,6 +1258,10 @@ static int ets_lkg_block_did_become_partially_empty (ets_lkg_t *lkg, ets_block_t
 
     /* does 0T go above linkage level under any circumstances */
 
+    /* cauterized blocks rejoin the count */
+    if (block->b_prev == nullptr && block->b_next == nullptr) {
+        ++lkg->l_nblocks;
+    }
     if (block->b_prev != nullptr)
         block->b_prev->b_next = block->b_next;
     if (block->b_next != nullptr)
@@ -769,232 +1285,763 @@ static int ets_lkg_block_did_become_partially_empty (ets_lkg_t *lkg, ets_block_t
 
 /* SECTION: CHUNK */
 
+//! Monotonic time in nanoseconds, as coarse as the system allows; chunk
+//! cache decay is measured in seconds.
+static inline uint64_t ets_now_ns ()
+{
+    struct timespec ts;
+#if defined CLOCK_MONOTONIC_COARSE
+    clock_gettime (CLOCK_MONOTONIC_COARSE, &ts);
+#else
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+#endif
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+//! Thread-safe: LOCKED
+static inline void ets_purged_list_insert (ets_chunk_t *chunk)
+{
+    chunk->c_purged_prev = nullptr;
+    chunk->c_purged_next = __ets_purged_list.pl_first;
+    if (chunk->c_purged_next)
+        chunk->c_purged_next->c_purged_prev = chunk;
+    __ets_purged_list.pl_first = chunk;
+}
+
+//! Thread-safe: LOCKED
+static inline void ets_purged_list_remove (ets_chunk_t *chunk)
+{
+    if (chunk->c_purged_prev)
+        chunk->c_purged_prev->c_purged_next = chunk->c_purged_next;
+    else
+        __ets_purged_list.pl_first = chunk->c_purged_next;
+    if (chunk->c_purged_next)
+        chunk->c_purged_next->c_purged_prev = chunk->c_purged_prev;
+}
+
 static int ets_block_free (ets_block_t *block)
 {
-    CTXUP ("ets_block_free called with block=%p");
+    CTXUP ("ets_block_free called with block=%p", block);
     ets_chunk_t *chunk = ets_get_chunk_for_block (block);
     const size_t block_no = ets_get_block_no (block);
-    const size_t remaining = __atomic_sub_fetch (&chunk->c_nactive, 1, __ATOMIC_SEQ_CST);
-    LOG ("determined chunk=%p (block #%zu) with %zu remaining", chunk, block_no, remaining);
-    __atomic_and_fetch (&chunk->c_active_mask, ~(1 << ets_get_block_no (block)), __ATOMIC_SEQ_CST);
+    const size_t nblocks = block->b_nblocks;
+    const uint64_t bits = ((1ul << nblocks) - 1) << block_no;
+    __atomic_and_fetch (&chunk->c_active_mask, ~bits, __ATOMIC_SEQ_CST);
+    for (size_t i = 1; i < nblocks; ++i) {
+        chunk->c_span_head[block_no + 1 + i] = 0;
+    }
     ets_mutex_unlock (&block->b_access);
     ets_block_clean (block);
-    ets_pages_free (block, ETS_BLOCK_SIZE);
+    /* the mapping stays: unmapping single blocks splinters the chunk into as
+     * many mappings, each of which costs a TLB shootdown to take down */
+#if !ETS_FEATURE_CHUNK_HUGE_PAGES
+    /* the purge is put off, and saved if the block is reused first, or if
+     * its chunk empties and goes to the chunk cache whole and resident: with
+     * the background thread running, it waits out the decay period there;
+     * otherwise, the blocks left are purged all at once by the free that
+     * takes them past the cap. Without either, it happens here */
+    const bool bgmm_running = ETS_BGMM_RUNNING == __atomic_load_n (&__ets_bgmm.bg_state, __ATOMIC_SEQ_CST);
+    const bool cache_enabled = __atomic_load_n (&__ets_chunk_cache_decay_ns, __ATOMIC_RELAXED)
+                               && __atomic_load_n (&__ets_chunk_cache_max_nchunks, __ATOMIC_RELAXED);
+    const size_t ndirty = __atomic_load_n (&__ets_purged_list.pl_ndirty, __ATOMIC_RELAXED);
+    const bool deferred = (bgmm_running || cache_enabled) && ndirty < 2 * ETS_BGMM_DIRTY_MAX_BYTES / ETS_BLOCK_SIZE;
+    bool purge_dirty = false;
+    if (deferred && ndirty >= ETS_BGMM_DIRTY_MAX_BYTES / ETS_BLOCK_SIZE) {
+        if (!bgmm_running) {
+            purge_dirty = true;
+        } else if (!__atomic_exchange_n (&__ets_bgmm.bg_purge_now, true, __ATOMIC_SEQ_CST)) {
+            ets_bgmm_wake ();
+        }
+    }
+    if (!deferred) {
+        ets_pages_purge (block, nblocks * ETS_BLOCK_SIZE);
+    }
+#else
+    /* and with huge pages, so would purging them, page by page: the block
+     * stays resident, and the memory goes with its chunk's huge page */
+    const bool deferred = false;
+    const bool purge_dirty = false;
+#endif
 
+    /* c_nactive only ever changes under the purged list's lock once a chunk
+     * is bound, so a chunk cannot be freed from under a reuse */
+    ets_mutex_lock (&__ets_purged_list.pl_access);
+    const size_t remaining = __atomic_sub_fetch (&chunk->c_nactive, nblocks, __ATOMIC_SEQ_CST);
+    LOG ("determined chunk=%p (block #%zu, %zu long) with %zu remaining", chunk, block_no, nblocks, remaining);
     if (!remaining) {
-        const int r = ets_chunk_free (chunk);
+        if (chunk->c_purged_mask) {
+            ets_purged_list_remove (chunk);
+        }
+        __ets_purged_list.pl_ndirty -= __builtin_popcountl (chunk->c_dirty_mask);
+        chunk->c_dirty_mask = 0;
+        ets_mutex_unlock (&__ets_purged_list.pl_access);
+        const int r = ets_chunk_free (chunk, &__ets_chunk_cache);
         CTXDOWN ("attempt to free chunk %p returned %i", chunk, r);
         return r;
     }
-    CTXDOWN ("block %p freed", block);
+    if (!chunk->c_purged_mask) {
+        ets_purged_list_insert (chunk);
+    }
+    chunk->c_purged_mask |= bits;
+    if (deferred) {
+        chunk->c_dirty_at = ets_now_ns ();
+        chunk->c_dirty_mask |= bits;
+        __ets_purged_list.pl_ndirty += nblocks;
+    }
+    ets_mutex_unlock (&__ets_purged_list.pl_access);
+    if (purge_dirty) {
+        const int r = ets_bgmm_purge (ets_now_ns (), 0);
+        CTXDOWN ("block %p left to purge; purging every block left returned %i", block, r);
+        return r;
+    }
+    CTXDOWN ("block %p %s", block, deferred ? "left to purge" : "purged");
     return E_OK;
 }
 
-static int ets_chunk_bind_impl (ets_chunk_t *chunk, ets_chunk_tracker_t *tracker)
+static int ets_chunk_reuse_purged (size_t nblocks, ets_block_t **blockp)
 {
-    CTXUP ("ets_chunk_bind_impl called with chunk = %p, tracker = %p");
-    chunk->c_tracker = tracker;
-    ets_mutex_lock (&tracker->ct_access);
-    chunk->c_prev = nullptr;
-    chunk->c_next = __atomic_load_n (&tracker->ct_first, __ATOMIC_SEQ_CST);
-    if (chunk->c_next)
-        chunk->c_next->c_prev = chunk;
-    __atomic_store_n (&tracker->ct_first, chunk, __ATOMIC_SEQ_CST);
-    ets_mutex_unlock (&tracker->ct_access);
-    LOG ("tracker updated")
-
-    chunk->c_nactive = 0;
-    chunk->c_active_mask = 0;
-
-    for (size_t block_no = 1; block_no < 64; ++block_no) {
-        ets_block_t *block = (ets_block_t *)((uint8_t *)chunk + block_no * ETS_BLOCK_SIZE);
-        const int r = ets_block_init (block);
-        if (E_OK == r) {
-            chunk->c_active_mask |= (1 << (block_no - 1));
-            ++chunk->c_nactive;
+    if (!__atomic_load_n (&__ets_purged_list.pl_first, __ATOMIC_RELAXED)) {
+        return E_EMPTY;
+    }
+    ets_mutex_lock (&__ets_purged_list.pl_access);
+    /* of the first few chunks, the fullest that can take the run, so that
+     * emptier chunks get a chance to drain and be unmapped; the scan is
+     * bounded since the lock is global */
+    ets_chunk_t *best = nullptr;
+    uint64_t best_runs = 0;
+    size_t nseen = 0;
+    for (ets_chunk_t *chunk = __ets_purged_list.pl_first; chunk && nseen < ETS_PURGED_REUSE_SCAN;
+         chunk = chunk->c_purged_next, ++nseen) {
+        /* starts of runs of at least nblocks purged blocks */
+        uint64_t runs = chunk->c_purged_mask;
+        for (size_t i = 1; i < nblocks && runs; ++i) {
+            runs &= chunk->c_purged_mask >> i;
+        }
+        if (!runs) continue;
+        if (!best || chunk->c_nactive > best->c_nactive) {
+            best = chunk;
+            best_runs = runs;
         }
-        //LOG ("block init for #%zu returned %i -> nactive=%zu, active_mask=%zx",
-        //     block_no, r, chunk->c_nactive, chunk->c_active_mask);
     }
-    CTXDOWN ("ets_chunk_bind_impl finishing with %zu/63 active (%zx)",
-             chunk->c_nactive, chunk->c_active_mask);
+    if (!best) {
+        ets_mutex_unlock (&__ets_purged_list.pl_access);
+        return E_EMPTY;
+    }
+
+    ets_chunk_t *const chunk = best;
+    const size_t block_no = __builtin_ctzl (best_runs);
+    const uint64_t bits = ((1ul << nblocks) - 1) << block_no;
+    chunk->c_purged_mask &= ~bits;
+    __ets_purged_list.pl_ndirty -= __builtin_popcountl (chunk->c_dirty_mask & bits);
+    chunk->c_dirty_mask &= ~bits;
+    if (!chunk->c_purged_mask) {
+        ets_purged_list_remove (chunk);
+    }
+    __atomic_add_fetch (&chunk->c_nactive, nblocks, __ATOMIC_SEQ_CST);
+    __atomic_or_fetch (&chunk->c_active_mask, bits, __ATOMIC_SEQ_CST);
+    ets_mutex_unlock (&__ets_purged_list.pl_access);
 
+    (*blockp) = (ets_block_t *)((uint8_t *)chunk + (block_no + 1) * ETS_BLOCK_SIZE);
     return E_OK;
 }
 
-static int ets_chunk_bind (ets_chunk_t *chunk, ets_heap_t *root, ets_chunk_tracker_t *tracker)
+static int ets_chunk_bind_impl (ets_chunk_t *chunk)
 {
-    CTXUP ("ets_chunk_bind called with chunk=%p, root=%p, tracker=%p", chunk, root, tracker);
-    const int r = ets_chunk_bind_impl (chunk, tracker);
+    CTXUP ("ets_chunk_bind_impl called with chunk = %p", chunk);
+
+    /* block headers are left alone until each block is first used: every
+     * block counts as active from the start, and only the chunk header page
+     * is touched here */
+    chunk->c_nactive = 63;
+    chunk->c_active_mask = (1ul << 63) - 1;
+    chunk->c_purged_mask = 0;
+    chunk->c_dirty_mask = 0;
+    memset (chunk->c_span_head, 0, sizeof chunk->c_span_head);
+
+    /* the header is in order before the chunk can be found from the map */
+    const int r = ets_pmap_set (&__ets_page_map, chunk, 1, (uintptr_t)chunk | ETS_PMAP_CHUNK);
     if (E_OK != r) {
-        CTXDOWN ("bind_impl failed with error %i", r);
+        CTXDOWN ("ets_pmap_set failed with error code %i", r)
         return r;
     }
 
-    VAR (int n_bound = 0;)
-    for (size_t block_no = 1; block_no < 64; ++block_no) {
-        const int filter = (1 << (block_no - 1));
-        if (chunk->c_active_mask & filter) {
-            ets_block_t *block = (ets_block_t *)((uint8_t *)chunk + block_no * ETS_BLOCK_SIZE);
-            ets_heap_receive_applicant (root, block);
-            VAR (++n_bound);
-        } else {
-            LOG ("unbound block #%zu, mask=%zx, filter=%zx",
-                 block_no, chunk->c_active_mask, filter);
-        }
-    }
-    CTXDOWN ("dispatched %i/63 blocks", n_bound);
+    CTXDOWN ("ets_chunk_bind_impl finishing with %zu/63 active (%zx)",
+             chunk->c_nactive, chunk->c_active_mask);
+
     return E_OK;
 }
 
-static int ets_chunk_reserve_and_bind (ets_chunk_t *chunk, ets_block_t **lift, ets_heap_t *root, ets_chunk_tracker_t *tracker)
+static int ets_span_carve (ets_heap_t *root, size_t lkgi, ets_block_t **blockp)
 {
-    CTXUP ("ets_chunk_reserve_and_bind called with chunk=%p, root=%p, tracker=%p");
-    const int r = ets_chunk_bind_impl (chunk, tracker);
+    const size_t nblocks = ets_span_nblocks (lkgi);
+    CTXUP ("ets_span_carve called with root=%p, lkgi=%zu (%zu blocks), blockp=%p",
+           root, lkgi, nblocks, blockp)
+
+    ets_block_t *block;
+    const int r = ets_span_take (root, nblocks, &block);
     if (E_OK != r) {
-        CTXDOWN ("bind_impl failed with error %i", r);
+        CTXDOWN ("ets_span_take failed with error code %i", r)
         return r;
     }
+    ets_block_init (block);
+    block->b_nblocks = nblocks;
+    ets_block_format_to_size (block, ets_rlup_sli (lkgi));
+    ets_mutex_lock (&block->b_access);
+    (*blockp) = block;
+    CTXDOWN ("carved span %p", block)
+    return E_OK;
+}
 
-    VAR (int n_bound = 0;)
-    bool has_lifted = 0;
-    for (size_t block_no = 1; block_no < 64; ++block_no) {
-        uint64_t filter = (1 << (block_no - 1));
-        if (chunk->c_active_mask & filter) {
-            ets_block_t *block = (ets_block_t *)((uint8_t *)chunk + block_no * ETS_BLOCK_SIZE);
-            if (!has_lifted) {
-                has_lifted = 1;
-                (*lift) = block;
-            } else {
-                ets_heap_receive_applicant (root, block);
+static int ets_span_take (ets_heap_t *root, size_t nblocks, ets_block_t **blockp)
+{
+    CTXUP ("ets_span_take called with root=%p, nblocks=%zu, blockp=%p", root, nblocks, blockp)
+
+    /* purged blocks are already mapped, and come back before fresh ones */
+    {
+        ets_block_t *block;
+        if (E_OK == ets_chunk_reuse_purged (nblocks, &block)) {
+            ets_chunk_t *const chunk = ets_get_chunk_for_block (block);
+            const size_t head_no = ets_get_block_no (block) + 1;
+            for (size_t i = 1; i < nblocks; ++i) {
+                chunk->c_span_head[head_no + i] = i;
             }
-            VAR (++n_bound;);
-        } else {
-            LOG ("unbound block #%zu, mask=%zx, filter=%zx",
-                 block_no, chunk->c_active_mask, filter);
+            (*blockp) = block;
+            CTXDOWN ("reused purged span %p (#%zu-#%zu) from chunk %p", block, head_no, head_no + nblocks - 1, chunk)
+            return E_OK;
         }
     }
-    CTXDOWN ("dispatched %i/63 blocks, split %i|%i", n_bound, has_lifted, n_bound - has_lifted);
 
-    return has_lifted ? E_OK : E_FAIL;
+    ets_chunk_t *retired = nullptr;
+    size_t retired_from = 64;
+    bool wake = false;
+    ets_mutex_lock (&__ets_span_frontier.sf_access);
+    if (__ets_span_frontier.sf_next + nblocks > 64) {
+        ets_chunk_t *chunk;
+        /* a chunk provisioned ahead is bound and resident already */
+        if (__ets_span_frontier.sf_ready) {
+            chunk = __ets_span_frontier.sf_ready;
+            __ets_span_frontier.sf_ready = chunk->c_cache_next;
+            --__ets_span_frontier.sf_nready;
+            /* once per half of the target, not on every pop */
+            wake = __ets_span_frontier.sf_nready
+                   == __atomic_load_n (&__ets_span_frontier.sf_target, __ATOMIC_RELAXED) / 2;
+            LOG ("took provisioned chunk %p", chunk)
+        } else {
+            const int r = ets_chunk_alloc (&chunk);
+            if (E_OK != r) {
+                ets_mutex_unlock (&__ets_span_frontier.sf_access);
+                CTXDOWN ("ets_chunk_alloc failed with error code %i", r)
+                return r;
+            }
+            const int br = ets_chunk_bind_impl (chunk);
+            if (E_OK != br) {
+                ets_mutex_unlock (&__ets_span_frontier.sf_access);
+                ets_chunk_release (chunk);
+                CTXDOWN ("ets_chunk_bind_impl failed with error code %i", br)
+                return br;
+            }
+        }
+        retired = __ets_span_frontier.sf_chunk;
+        retired_from = __ets_span_frontier.sf_next;
+        __ets_span_frontier.sf_chunk = chunk;
+        __ets_span_frontier.sf_next = 1;
+    }
+    ets_chunk_t *const chunk = __ets_span_frontier.sf_chunk;
+    const size_t head_no = __ets_span_frontier.sf_next;
+    __ets_span_frontier.sf_next += nblocks;
+    __atomic_add_fetch (&__ets_span_frontier.sf_ncarved, nblocks, __ATOMIC_RELAXED);
+    ets_mutex_unlock (&__ets_span_frontier.sf_access);
+    if (wake) {
+        ets_bgmm_wake ();
+    }
+
+    /* whatever the old frontier could not fit goes to the unsized linkage,
+     * as long as the linkage wants it; otherwise the blocks would pin the
+     * chunk indefinitely */
+    if (retired) {
+        LOG ("retiring frontier chunk %p from block #%zu", retired, retired_from)
+        for (size_t block_no = retired_from; block_no < 64; ++block_no) {
+            ets_block_t *leftover = (ets_block_t *)((uint8_t *)retired + block_no * ETS_BLOCK_SIZE);
+            ets_block_init (leftover);
+            if (ets_should_lkg_recv_block (root, &root->h_lkgs[0])) {
+                ets_heap_receive_applicant (root, leftover);
+            } else {
+                ets_mutex_lock (&leftover->b_access);
+                ets_block_free (leftover);
+            }
+        }
+    }
+
+    ets_block_t *block = (ets_block_t *)((uint8_t *)chunk + head_no * ETS_BLOCK_SIZE);
+    for (size_t i = 1; i < nblocks; ++i) {
+        chunk->c_span_head[head_no + i] = i;
+    }
+    (*blockp) = block;
+    CTXDOWN ("took span %p (#%zu-#%zu) from chunk %p", block, head_no, head_no + nblocks - 1, chunk)
+    return E_OK;
 }
 
-static int ets_chunk_free (ets_chunk_t *chunk)
+static bool ets_span_frontier_provision ()
 {
-    CTXUP ("ets_chunk_free called with chunk=%p");
-    size_t block_adjust = 62;
-    uint64_t mask = chunk->c_active_mask;
-    while (chunk->c_active_mask) {
-        const size_t nlz = __builtin_clzl (mask);
-        const size_t block_no = block_adjust - nlz;
-        mask <<= nlz;
-        block_adjust -= nlz;
-        const size_t span = __builtin_clzl (~mask);
-        for (size_t i = 0; i < span; ++i) {
-            ets_block_clean ((ets_block_t *)((uint8_t *)chunk + ETS_BLOCK_SIZE * (block_no + i + 1)));
+    ets_span_frontier_t *const sf = &__ets_span_frontier;
+    if (__atomic_load_n (&sf->sf_nready, __ATOMIC_RELAXED) < __atomic_load_n (&sf->sf_target, __ATOMIC_RELAXED)) {
+        ets_chunk_t *chunk;
+        if (E_OK != ets_chunk_alloc (&chunk)) {
+            return false;
+        }
+        /* the whole chunk, not just the headers: formatting touches
+         * nothing and carving faults pages in one object at a time, on the
+         * allocating thread; frontier blocks go out whole and are carved
+         * soon after, so faulting them in here is the point */
+        ets_pages_prefault (chunk, ETS_CHUNK_SIZE);
+        if (E_OK != ets_chunk_bind_impl (chunk)) {
+            ets_chunk_release (chunk);
+            return false;
+        }
+        ets_mutex_lock (&sf->sf_access);
+        chunk->c_cache_next = sf->sf_ready;
+        sf->sf_ready = chunk;
+        const bool short_of_target = ++sf->sf_nready < __atomic_load_n (&sf->sf_target, __ATOMIC_RELAXED);
+        ets_mutex_unlock (&sf->sf_access);
+        CTX ("provisioned chunk %p", chunk)
+        return short_of_target;
+    }
+
+    /* once demand dies down, whatever is left over goes to the cache, to
+     * decay there */
+    if (__atomic_load_n (&sf->sf_nready, __ATOMIC_RELAXED) > __atomic_load_n (&sf->sf_target, __ATOMIC_RELAXED)) {
+        ets_chunk_t *excess = nullptr;
+        ets_mutex_lock (&sf->sf_access);
+        while (sf->sf_nready > __atomic_load_n (&sf->sf_target, __ATOMIC_RELAXED)) {
+            ets_chunk_t *const chunk = sf->sf_ready;
+            sf->sf_ready = chunk->c_cache_next;
+            --sf->sf_nready;
+            chunk->c_cache_next = excess;
+            excess = chunk;
+        }
+        ets_mutex_unlock (&sf->sf_access);
+        while (excess) {
+            ets_chunk_t *const next = excess->c_cache_next;
+            ets_chunk_free (excess, &__ets_chunk_cache);
+            excess = next;
         }
-        uint8_t *const locus = (uint8_t *)chunk + ETS_BLOCK_SIZE + ETS_BLOCK_SIZE * block_no;
-        const int r = ets_pages_free ((void *)locus, span * ETS_BLOCK_SIZE);
-        LOG ("freeing %zu blocks starting at block #%zu returned %i", span, block_no, r);
     }
-    ets_chunk_tracker_t *const tracker = chunk->c_tracker;
-    ets_mutex_lock (&tracker->ct_access);
-    if (chunk == __atomic_load_n (&tracker->ct_first, __ATOMIC_SEQ_CST)) {
-        __atomic_store_n (&tracker->ct_first, chunk->c_next, __ATOMIC_SEQ_CST);
-        if (chunk->c_next)
-            chunk->c_next->c_prev = nullptr;
-    } else {
-        chunk->c_prev->c_next = chunk->c_next;
-        if (chunk->c_next)
-            chunk->c_next->c_prev = chunk->c_prev;
+    return false;
+}
+
+static void ets_span_frontier_unprovision ()
+{
+    ets_span_frontier_t *const sf = &__ets_span_frontier;
+    ets_mutex_lock (&sf->sf_access);
+    __atomic_store_n (&sf->sf_target, 0, __ATOMIC_RELAXED);
+    ets_chunk_t *ready = sf->sf_ready;
+    sf->sf_ready = nullptr;
+    sf->sf_nready = 0;
+    ets_mutex_unlock (&sf->sf_access);
+    while (ready) {
+        ets_chunk_t *const next = ready->c_cache_next;
+        ets_pmap_set (&__ets_page_map, ready, 1, ETS_PMAP_NONE);
+        ets_chunk_release (ready);
+        CTX ("released provisioned chunk %p", ready)
+        ready = next;
     }
-    ets_mutex_unlock (&tracker->ct_access);
-    LOG ("tracker updated")
+}
+
+static int ets_chunk_free (ets_chunk_t *chunk, ets_chunk_cache_t *cache)
+{
+    CTXUP ("ets_chunk_free called with chunk=%p, cache=%p", chunk, cache);
+    ets_pmap_set (&__ets_page_map, chunk, 1, ETS_PMAP_NONE);
+    LOG ("page map updated")
+
+    /* every block is inactive, so the chunk goes in one piece, to the front
+     * of the cache */
+    const uint64_t now = ets_now_ns ();
+    chunk->c_retired_at = now;
+    chunk->c_cache_prev = nullptr;
+    ets_mutex_lock (&cache->cc_access);
+    chunk->c_cache_next = cache->cc_first;
+    if (cache->cc_first)
+        cache->cc_first->c_cache_prev = chunk;
+    else
+        cache->cc_last = chunk;
+    cache->cc_first = chunk;
+    ++cache->cc_nchunks;
+    ets_mutex_unlock (&cache->cc_access);
+
+    const int r = ets_chunk_cache_trim (cache, now,
+                                        __atomic_load_n (&__ets_chunk_cache_decay_ns, __ATOMIC_RELAXED),
+                                        __atomic_load_n (&__ets_chunk_cache_max_nchunks, __ATOMIC_RELAXED));
+    CTXDOWN ("retired chunk; trimming the cache returned %i", r)
+    return r;
+}
 
-    /* free the header */
-    const int r = ets_pages_free (chunk, ETS_BLOCK_SIZE);
-    CTXDOWN ("freeing header page returned %i", r)
+static int ets_chunk_release (ets_chunk_t *chunk)
+{
+    CTXUP ("ets_chunk_release called with chunk=%p", chunk);
+#if ETS_FEATURE_CHUNK_ARENA
+    if (ets_arena_contains (&__ets_arena, chunk)) {
+        const int r = ets_arena_free_chunk (&__ets_arena, chunk);
+        CTXDOWN ("returning chunk to the arena returned %i", r)
+        return r;
+    }
+#endif
+    const int r = ets_pages_free (chunk, ETS_CHUNK_SIZE);
+    CTXDOWN ("unmapping chunk returned %i", r)
     if (0 != r) return r;
 
     return E_OK;
 }
 
+static int ets_chunk_cache_trim (ets_chunk_cache_t *cache, uint64_t now, uint64_t decay_ns, size_t max_nchunks)
+{
+    /* the oldest chunks are at the back: unhook them under the lock, and
+     * release them outside it */
+    ets_chunk_t *released = nullptr;
+    ets_mutex_lock (&cache->cc_access);
+    while (cache->cc_last
+           && (cache->cc_nchunks > max_nchunks || now - cache->cc_last->c_retired_at >= decay_ns)) {
+        ets_chunk_t *const chunk = cache->cc_last;
+        cache->cc_last = chunk->c_cache_prev;
+        if (cache->cc_last)
+            cache->cc_last->c_cache_next = nullptr;
+        else
+            cache->cc_first = nullptr;
+        --cache->cc_nchunks;
+        chunk->c_cache_next = released;
+        released = chunk;
+    }
+    ets_mutex_unlock (&cache->cc_access);
+
+    int r = E_OK;
+    while (released) {
+        ets_chunk_t *const next = released->c_cache_next;
+        const int rr = ets_chunk_release (released);
+        if (E_OK != rr) r = rr;
+        released = next;
+    }
+    return r;
+}
+
+//! Take the most recently retired chunk off a cache, if it has any.
+//! Thread-safe: 1
+static ets_chunk_t *ets_chunk_cache_pop (ets_chunk_cache_t *cache)
+{
+    if (!__atomic_load_n (&cache->cc_first, __ATOMIC_RELAXED)) {
+        return nullptr;
+    }
+    ets_mutex_lock (&cache->cc_access);
+    ets_chunk_t *const chunk = cache->cc_first;
+    if (chunk) {
+        cache->cc_first = chunk->c_cache_next;
+        if (cache->cc_first)
+            cache->cc_first->c_cache_prev = nullptr;
+        else
+            cache->cc_last = nullptr;
+        --cache->cc_nchunks;
+    }
+    ets_mutex_unlock (&cache->cc_access);
+    return chunk;
+}
+
 static int ets_chunk_alloc (ets_chunk_t **chunkp)
 {
     CTXUP ("ets_chunk_alloc called with chunkp=%p", chunkp)
     (*chunkp) = nullptr;
 
-    const int r = ets_pages_alloc_aligned ((void **)chunkp, ETS_CHUNK_SIZE, ETS_CHUNK_SIZE);
+    /* a retired chunk is still resident, so it comes back without a fault */
+    int r = E_FAIL;
+    ets_chunk_t *cached = ets_chunk_cache_pop (&__ets_chunk_cache);
+    if (cached) {
+        (*chunkp) = cached;
+        r = E_OK;
+    }
+#if ETS_FEATURE_CHUNK_ARENA
+    if (E_OK != r) {
+        r = ets_arena_alloc_chunk (&__ets_arena, (void **)chunkp);
+    }
+#endif
+    /* past the last region the arena can reserve, chunks are mapped on their
+     * own */
+    if (E_OK != r) {
+        r = ets_pages_alloc_aligned ((void **)chunkp, ETS_CHUNK_SIZE, ETS_CHUNK_SIZE);
+    }
     if (E_OK != r) {
         CTXDOWN ("ets_pages_alloc_aligned failed with error code %i", r)
         return r;
     }
-    (*chunkp)->c_next = nullptr;
-    (*chunkp)->c_tracker = nullptr;
+    (*chunkp)->c_flags = 0;
     (*chunkp)->c_active_mask = 0;
+    (*chunkp)->c_purged_mask = 0;
+    (*chunkp)->c_dirty_mask = 0;
     (*chunkp)->c_nactive = 0;
 
     CTXDOWN ("succeeded, chunk=%p", *chunkp)
     return E_OK;
 }
 
-/* SECTION: HEAP */
+static int ets_bgmm_purge (uint64_t now, uint64_t decay_ns)
+{
+    CTXUP ("ets_bgmm_purge called with now=%lu, decay_ns=%lu", now, decay_ns)
+    struct
+    {
+        ets_chunk_t *chunk;
+        uint64_t bits;
+    } batch[ETS_BGMM_PURGE_BATCH];
+    size_t n, n_purged = 0;
+    int r = E_OK;
+    do {
+        /* claim the expired blocks: off the purged list, and counted as
+         * active, so that neither a reuse nor a chunk free can race the
+         * purge, which runs unlocked */
+        n = 0;
+        ets_mutex_lock (&__ets_purged_list.pl_access);
+        for (ets_chunk_t *chunk = __ets_purged_list.pl_first, *next; chunk && n < ETS_BGMM_PURGE_BATCH;
+             chunk = next) {
+            next = chunk->c_purged_next;
+            if (!chunk->c_dirty_mask || chunk->c_dirty_at + decay_ns > now) continue;
+            const uint64_t bits = chunk->c_dirty_mask;
+            chunk->c_dirty_mask = 0;
+            __ets_purged_list.pl_ndirty -= __builtin_popcountl (bits);
+            chunk->c_purged_mask &= ~bits;
+            if (!chunk->c_purged_mask) {
+                ets_purged_list_remove (chunk);
+            }
+            __atomic_add_fetch (&chunk->c_nactive, __builtin_popcountl (bits), __ATOMIC_SEQ_CST);
+            batch[n].chunk = chunk;
+            batch[n].bits = bits;
+            ++n;
+        }
+        ets_mutex_unlock (&__ets_purged_list.pl_access);
+
+        /* one purge per run of contiguous blocks */
+        for (size_t i = 0; i < n; ++i) {
+            uint64_t rest = batch[i].bits;
+            while (rest) {
+                const size_t block_no = __builtin_ctzl (rest);
+                const size_t len = __builtin_ctzl (~(rest >> block_no));
+                const int pr = ets_pages_purge ((uint8_t *)batch[i].chunk + (block_no + 1) * ETS_BLOCK_SIZE,
+                                                len * ETS_BLOCK_SIZE);
+                if (E_OK != pr) r = pr;
+                rest &= ~(((1ul << len) - 1) << block_no);
+            }
+        }
 
-static int ets_heap_alloc_object (ets_heap_t *heap, void **object, size_t osize)
+        /* and give them back; a chunk whose other blocks all went in the
+         * meantime is freed here */
+        ets_chunk_t *freed = nullptr;
+        ets_mutex_lock (&__ets_purged_list.pl_access);
+        for (size_t i = 0; i < n; ++i) {
+            ets_chunk_t *const chunk = batch[i].chunk;
+            const size_t remaining = __atomic_sub_fetch (&chunk->c_nactive, __builtin_popcountl (batch[i].bits),
+                                                         __ATOMIC_SEQ_CST);
+            if (!remaining) {
+                if (chunk->c_purged_mask) {
+                    ets_purged_list_remove (chunk);
+                }
+                __ets_purged_list.pl_ndirty -= __builtin_popcountl (chunk->c_dirty_mask);
+                chunk->c_dirty_mask = 0;
+                chunk->c_purged_next = freed;
+                freed = chunk;
+                continue;
+            }
+            if (!chunk->c_purged_mask) {
+                ets_purged_list_insert (chunk);
+            }
+            chunk->c_purged_mask |= batch[i].bits;
+        }
+        ets_mutex_unlock (&__ets_purged_list.pl_access);
+        while (freed) {
+            ets_chunk_t *const next = freed->c_purged_next;
+            const int fr = ets_chunk_free (freed, &__ets_chunk_cache);
+            if (E_OK != fr) r = fr;
+            freed = next;
+        }
+        n_purged += n;
+    } while (n == ETS_BGMM_PURGE_BATCH);
+    CTXDOWN ("purged blocks of %zu chunks, status=%i", n_purged, r)
+    return r;
+}
+
+/* SECTION: LARGE */
+
+static int ets_large_alloc_object (void **object, size_t osize, size_t align)
 {
-    if (!osize) {
+    CTXUP ("ets_large_alloc_object called with objectp=%p, osize=%zu, align=%zu", object, osize, align)
+    /* the region is aligned to at least a chunk and to `align`, so any power
+     * of two past the header size is honoured by starting the object that
+     * far in; the pages skipped over are never touched */
+    const size_t offset = align > ETS_LARGE_HEADER_SIZE ? align : ETS_LARGE_HEADER_SIZE;
+    const size_t region_align = align > ETS_CHUNK_SIZE ? align : ETS_CHUNK_SIZE;
+    size_t msize;
+    if (__builtin_add_overflow (offset, osize + ETS_PAGE_SIZE - 1, &msize) || osize + ETS_PAGE_SIZE - 1 < osize
+        || msize > SIZE_MAX - region_align) {
         (*object) = nullptr;
+        CTXDOWN ("failed: size overflow")
         return E_FAIL;
     }
-    size_t lkgi = ets_lup_sli (osize);
-    CTXUP ("ets_heap_alloc_object called with heap=%p, objectp=%p, osize=%zu | LKGI=%zu",
-           heap, object, osize, lkgi)
-    /* TODO: large!! */
-    if (lkgi >= heap->h_nlkgs) {
-        return E_NXLKG;
+    msize &= ~(ETS_PAGE_SIZE - 1);
+    ets_large_t *large;
+    const int r = ets_pages_alloc_aligned ((void **)&large, msize, region_align);
+    if (E_OK != r) {
+        (*object) = nullptr;
+        CTXDOWN ("ets_pages_alloc_aligned failed with error code %i", r)
+        return r;
     }
-    const int r = ets_lkg_alloc_object (&heap->h_lkgs[lkgi], heap, object);
-    CTXDOWN ("ets_lkg_alloc_object returned %i with object = %p", r, *object);
-    return r;
+    large->lg_chunk.c_flags = ETS_CHFL_LARGE;
+    large->lg_chunk.c_nactive = 1;
+    large->lg_chunk.c_active_mask = 0;
+    large->lg_osize = osize;
+    large->lg_msize = msize;
+    large->lg_offset = offset;
+    const int pr = ets_pmap_set (&__ets_page_map, large, ets_pmap_large_nchunks (msize),
+                                 (uintptr_t)large | ETS_PMAP_LARGE);
+    if (E_OK != pr) {
+        ets_pmap_set (&__ets_page_map, large, ets_pmap_large_nchunks (msize), ETS_PMAP_NONE);
+        ets_pages_free (large, msize);
+        (*object) = nullptr;
+        CTXDOWN ("ets_pmap_set failed with error code %i", pr)
+        return pr;
+    }
+    (*object) = ets_get_large_object (large);
+    CTXDOWN ("succeeded, large=%p, msize=%zu", large, msize)
+    return E_OK;
 }
 
-static int ets_heap_req_block_from_top (ets_heap_t *heap, size_t lkgi, ets_block_t **blockp)
+static int ets_large_dealloc_object (ets_large_t *large)
 {
-    CTXUP ("ets_heap_req_block_from_top called with heap=%p, lkgi=%zu, blockp=%p",
-           heap, lkgi, blockp)
-    ets_chunk_t *chunk;
+    CTX ("ets_large_dealloc_object called with large=%p, msize=%zu", large, large->lg_msize)
+    ets_pmap_set (&__ets_page_map, large, ets_pmap_large_nchunks (large->lg_msize), ETS_PMAP_NONE);
+    return ets_pages_free (large, large->lg_msize);
+}
+
+static int ets_large_realloc_object (ets_large_t *large, void **object, size_t osize)
+{
+    CTXUP ("ets_large_realloc_object called with large=%p, osize=%zu", large, osize)
+    const size_t old_msize = large->lg_msize;
+    size_t msize;
+    if (__builtin_add_overflow (large->lg_offset, osize + ETS_PAGE_SIZE - 1, &msize)
+        || osize + ETS_PAGE_SIZE - 1 < osize || msize > SIZE_MAX - large->lg_offset - ETS_CHUNK_SIZE) {
+        CTXDOWN ("failed: size overflow")
+        return E_FAIL;
+    }
+    msize &= ~(ETS_PAGE_SIZE - 1);
+    if (msize <= old_msize) {
+        /* shrinking never moves the object; hand the tail back */
+        if (msize < old_msize) {
+            const size_t nchunks = ets_pmap_large_nchunks (msize);
+            ets_pmap_set (&__ets_page_map, (uint8_t *)large + nchunks * ETS_CHUNK_SIZE,
+                          ets_pmap_large_nchunks (old_msize) - nchunks, ETS_PMAP_NONE);
+            ets_pages_free ((uint8_t *)large + msize, old_msize - msize);
+        }
+        large->lg_osize = osize;
+        large->lg_msize = msize;
+        (*object) = ets_get_large_object (large);
+        CTXDOWN ("shrunk in place")
+        return E_OK;
+    }
+#if __linux__
+    /* first try to extend the mapping without moving it */
+    if (MAP_FAILED != mremap (large, old_msize, msize, 0)) {
+        if (E_OK != ets_pmap_set (&__ets_page_map, large, ets_pmap_large_nchunks (msize),
+                                  (uintptr_t)large | ETS_PMAP_LARGE)) {
+            /* the old range had its leaves already */
+            mremap (large, msize, old_msize, 0);
+            ets_pmap_set (&__ets_page_map, large, ets_pmap_large_nchunks (msize), ETS_PMAP_NONE);
+            ets_pmap_set (&__ets_page_map, large, ets_pmap_large_nchunks (old_msize),
+                          (uintptr_t)large | ETS_PMAP_LARGE);
+            CTXDOWN ("ets_pmap_set failed")
+            return E_FAIL;
+        }
+        large->lg_msize = msize;
+        large->lg_osize = osize;
+        (*object) = ets_get_large_object (large);
+        CTXDOWN ("grew in place")
+        return E_OK;
+    }
+    /* otherwise, carve out a new aligned swath and have the kernel move the
+     * pages over it, which avoids copying the contents */
+    void *dest;
     {
-        const int r = ets_chunk_alloc (&chunk);
+        const int r = ets_pages_alloc_aligned (&dest, msize,
+                                               large->lg_offset > ETS_CHUNK_SIZE ? large->lg_offset : ETS_CHUNK_SIZE);
         if (E_OK != r) {
-            CTXDOWN ("ets_chunk_alloc failed with error code %i", r)
+            CTXDOWN ("ets_pages_alloc_aligned failed with error code %i", r)
             return r;
         }
     }
-
-    ets_block_t *block;
     {
-        const int r = ets_chunk_reserve_and_bind (chunk, &block, heap, &__ets_chunk_tracker);
+        const int r = ets_pmap_set (&__ets_page_map, dest, ets_pmap_large_nchunks (msize),
+                                    (uintptr_t)dest | ETS_PMAP_LARGE);
         if (E_OK != r) {
-            CTXDOWN ("ets_chunk_reserve_and_bind failed for chunk %p with error code %i",
-                     chunk, r);
+            ets_pmap_set (&__ets_page_map, dest, ets_pmap_large_nchunks (msize), ETS_PMAP_NONE);
+            ets_pages_free (dest, msize);
+            CTXDOWN ("ets_pmap_set failed with error code %i", r)
             return r;
         }
     }
+    ets_pmap_set (&__ets_page_map, large, ets_pmap_large_nchunks (old_msize), ETS_PMAP_NONE);
+    void *moved = mremap (large, old_msize, msize, MREMAP_MAYMOVE | MREMAP_FIXED, dest);
+    if (MAP_FAILED == moved) {
+        CTX ("mremap failed with error code %i (%s); falling back to copy",
+             errno, strerror (errno))
+        memcpy ((uint8_t *)dest + large->lg_offset,
+                ets_get_large_object (large),
+                large->lg_osize < osize ? large->lg_osize : osize);
+        memcpy (dest, large, sizeof (ets_large_t));
+        ets_pages_free (large, old_msize);
+    }
+    large = (ets_large_t *)dest;
+#else
+    ets_large_t *fresh;
     {
-        const int r = ets_block_format_to_size (block, ets_rlup_sli (lkgi));
+        void *fresh_object;
+        const int r = ets_large_alloc_object (&fresh_object, osize, large->lg_offset);
         if (E_OK != r) {
-            CTXDOWN ("ets_block_format_to_size failed for block %p of chunk %p "
-                     "with error code %i for size %zu (lkgi=%zu)",
-                     block, chunk, r, ets_rlup_sli (lkgi), lkgi)
+            CTXDOWN ("ets_large_alloc_object failed with error code %i", r)
             return r;
         }
-        ets_mutex_lock (&block->b_access);
+        /* the header may lie more than a chunk before the object */
+        fresh = (ets_large_t *)((uint8_t *)fresh_object - large->lg_offset);
     }
-    (*blockp) = block;
-    CTXDOWN ("toplevel successfully reserved block %p", block)
+    memcpy (ets_get_large_object (fresh), ets_get_large_object (large), large->lg_osize);
+    ets_large_dealloc_object (large);
+    large = fresh;
+#endif
+    large->lg_msize = msize;
+    large->lg_osize = osize;
+    (*object) = ets_get_large_object (large);
+    CTXDOWN ("moved to large=%p", large)
     return E_OK;
 }
 
+/* SECTION: HEAP */
+
+static int ets_heap_alloc_object (ets_heap_t *heap, void **object, size_t osize)
+{
+    size_t lkgi = ets_lup_sli (osize);
+    CTXUP ("ets_heap_alloc_object called with heap=%p, objectp=%p, osize=%zu | LKGI=%zu",
+           heap, object, osize, lkgi)
+    if (lkgi >= heap->h_nlkgs) {
+        const int r = ets_large_alloc_object (object, osize, 0);
+        CTXDOWN ("ets_large_alloc_object returned %i with object = %p", r, *object);
+        return r;
+    }
+    const int r = ets_lkg_alloc_object (&heap->h_lkgs[lkgi], heap, object);
+    CTXDOWN ("ets_lkg_alloc_object returned %i with object = %p", r, *object);
+    return r;
+}
+
+static int ets_heap_req_block_from_top (ets_heap_t *heap, size_t lkgi, ets_block_t **blockp)
+{
+    CTXUP ("ets_heap_req_block_from_top called with heap=%p, lkgi=%zu, blockp=%p",
+           heap, lkgi, blockp)
+    /* single blocks come off the frontier as one-block spans, so that a new
+     * chunk costs one header per block actually used */
+    const int r = ets_span_carve (heap, lkgi, blockp);
+    CTXDOWN ("ets_span_carve returned %i; block=%p", r, *blockp)
+    return r;
+}
+
 static int ets_heap_req_block_from_heap (ets_heap_t *heap, size_t lkgi, ets_block_t **blockp)
 {
     CTXUP ("ets_heap_req_block_from_heap called with heap=%p, lkgi=%zu, blockp=%p",
@@ -1005,10 +2052,12 @@ static int ets_heap_req_block_from_heap (ets_heap_t *heap, size_t lkgi, ets_bloc
         CTXDOWN ("ets_heap_req_block_from_slkg succeeded with block=%p", *blockp)
         return E_OK;
     }
-    r = ets_heap_req_block_from_ulkg (&heap->h_lkgs[lkgi], ets_rlup_sli (lkgi), blockp);
-    if (r == E_OK) {
-        CTXDOWN ("ets_heap_req_block_from_ulkg succeeded with block=%p", *blockp)
-        return E_OK;
+    if (lkgi < ETS_LKGI_MEDIUM) {
+        r = ets_heap_req_block_from_ulkg (&heap->h_lkgs[0], ets_rlup_sli (lkgi), blockp);
+        if (r == E_OK) {
+            CTXDOWN ("ets_heap_req_block_from_ulkg succeeded with block=%p", *blockp)
+            return E_OK;
+        }
     }
     if (!heap->h_owning_heap) {
         r = ets_heap_req_block_from_top (heap, lkgi, blockp);
@@ -1052,6 +2101,7 @@ static int ets_heap_req_block_from_ulkg (ets_lkg_t *lkg, size_t osize, ets_block
         block_cache->b_prev->b_next = block_cache->b_next;
     if (block_cache->b_next)
         block_cache->b_next->b_prev = block_cache->b_prev;
+    --lkg->l_nblocks;
 
     ets_mutex_unlock (&lkg->l_access);
     if (block_cache->b_osize != osize) {
@@ -1084,8 +2134,7 @@ static int ets_heap_req_block_from_slkg (ets_lkg_t *lkg, ets_block_t **blockp)
     bool found_match = 0;
     while (block_cache != nullptr) {
         ets_mutex_lock (&block_cache->b_access);
-        if (nullptr == __atomic_load_n (&block_cache->b_gfl, __ATOMIC_SEQ_CST)
-            && nullptr == __atomic_load_n (&block_cache->b_pfl, __ATOMIC_SEQ_CST)) {
+        if (!ets_block_has_free (block_cache)) {
             if (__atomic_load_n (&lkg->l_active, __ATOMIC_SEQ_CST) == block_cache) {
                 if (block_cache->b_next != nullptr || block_cache->b_prev == NULL)
                     __atomic_store_n (&lkg->l_active, block_cache->b_next, __ATOMIC_SEQ_CST);
@@ -1100,6 +2149,7 @@ static int ets_heap_req_block_from_slkg (ets_lkg_t *lkg, ets_block_t **blockp)
             /* again, cauterize is optional, but makes things easier */
             block_cache->b_next = nullptr;
             block_cache->b_prev = nullptr;
+            --lkg->l_nblocks;
             ets_mutex_unlock (&block_cache->b_access);
             block_cache = tmp;
         } else {
@@ -1119,7 +2169,7 @@ static int ets_heap_req_block_from_slkg (ets_lkg_t *lkg, ets_block_t **blockp)
         ets_mutex_unlock (&lkg->l_access);
         return E_FAIL;
     }
-    ets_mutex_lock (&block_cache->b_access);
+    /* block_cache is still locked from the scan */
     ets_block_t *curr_head = __atomic_load_n (&lkg->l_active, __ATOMIC_SEQ_CST);
     if (curr_head == block_cache) {
         /* if both b_next AND b_prev are nullptr, it'll use b_next which is NULL */
@@ -1132,6 +2182,7 @@ static int ets_heap_req_block_from_slkg (ets_lkg_t *lkg, ets_block_t **blockp)
         block_cache->b_prev->b_next = block_cache->b_next;
     if (block_cache->b_next)
         block_cache->b_next->b_prev = block_cache->b_prev;
+    --lkg->l_nblocks;
 
     ets_mutex_unlock (&lkg->l_access);
     (*blockp) = block_cache;
@@ -1145,9 +2196,13 @@ static int ets_lkg_req_block_from_heap (ets_heap_t *heap, size_t lkgi, ets_block
      * % .callee LIVE HEAP
      */
 
-    ets_lkg_t *ulkg = &heap->h_lkgs[0];
-    const int r = ets_heap_req_block_from_ulkg (ulkg, ets_rlup_sli (lkgi), blockp);
-    if (r == E_OK) return E_OK;
+    __atomic_add_fetch (&heap->h_nreqs, 1, __ATOMIC_RELAXED);
+    /* unsized linkages only hold single blocks, which cannot host a span */
+    if (lkgi < ETS_LKGI_MEDIUM) {
+        ets_lkg_t *ulkg = &heap->h_lkgs[0];
+        const int r = ets_heap_req_block_from_ulkg (ulkg, ets_rlup_sli (lkgi), blockp);
+        if (r == E_OK) return E_OK;
+    }
     if (!heap->h_owning_heap) {
         return ets_heap_req_block_from_top (heap, lkgi, blockp);
     } else {
@@ -1162,33 +2217,244 @@ static int ets_block_init (ets_block_t *block)
     ets_opaque_block_t *opaque_block = (ets_opaque_block_t *)block;
     /* TODO: write these out properly */
     memset (block, 0, &opaque_block->b_memory[0] - (uint8_t *)block);
+    block->b_nblocks = 1;
 
-    pthread_mutex_init (&block->b_access, nullptr);
+    ets_lock_init (&block->b_access);
 
     return E_OK;
 }
 
 static int ets_block_clean (ets_block_t *block)
 {
-    pthread_mutex_destroy (&block->b_access);
+    /* b_access holds no resources of its own */
+    (void)block;
+
+    return E_OK;
+}
+
+#if ETS_FEATURE_BITMAP_BLOCKS
+//! Bytes taken by each of the two bitmaps of a block with `nwords` words per
+//! bitmap; 0 for list blocks.
+static inline size_t ets_block_bitmap_bytes (size_t nwords)
+{
+    return (nwords * sizeof (uint64_t) + ETS_CACHE_LINE_SIZE - 1) & ~(ETS_CACHE_LINE_SIZE - 1);
+}
+static inline uint64_t *ets_block_pbm (ets_block_t *block)
+{
+    return (uint64_t *)((ets_opaque_block_t *)block)->b_memory;
+}
+static inline uint64_t *ets_block_gbm (ets_block_t *block)
+{
+    return (uint64_t *)(((ets_opaque_block_t *)block)->b_memory + ets_block_bitmap_bytes (block->b_bmwords));
+}
+#endif
+
+//! Where a block's objects start.
+static inline uint8_t *ets_block_objects (ets_block_t *block)
+{
+    return ((ets_opaque_block_t *)block)->b_memory + block->b_objoff;
+}
+
+//! Start of the object `object` points into. Aligned allocations hand out
+//! an address some way into an object of a larger class; everything that
+//! takes an object back from outside goes through here first. The rounded-up
+//! reciprocal may overshoot by one object, never undershoot.
+//! Thread-safe: 1
+static inline void *ets_block_object_start (ets_block_t *block, void *object)
+{
+    uint8_t *const objects = ets_block_objects (block);
+    const uint64_t offset = (uint8_t *)object - objects;
+    uint8_t *start = objects + ((offset * block->b_osize_recip) >> 32) * block->b_osize;
+    if (start > (uint8_t *)object) start -= block->b_osize;
+    return start;
+}
+
+//! Colour for a block with `slack` bytes to spare past its last object: one
+//! of the cache-line offsets that fit in the slack, in turn by block address,
+//! so that neighbouring blocks start their objects on different sets.
+//! Thread-safe: 1
+static inline size_t ets_block_color (ets_block_t *block, size_t slack)
+{
+#if ETS_FEATURE_BLOCK_COLORING
+    const size_t ncolors = slack / ETS_CACHE_LINE_SIZE + 1;
+    return ((uintptr_t)block / ETS_BLOCK_SIZE) % ncolors * ETS_CACHE_LINE_SIZE;
+#else
+    return 0;
+#endif
+}
 
+#if ETS_FEATURE_BITMAP_BLOCKS
+//! Longest bitmap, in words: a single block of 8-byte objects, the smallest
+//! class any table may have.
+    #define ETS_BITMAP_MAX_WORDS ((ETS_BLOCK_SIZE / 8 + 63) / 64)
+
+//! Tail of `ets_block_format_to_size` for bitmap classes: every object is
+//! free in the private bitmap, and the free lists stay empty for good.
+static int ets_block_format_bitmap (ets_block_t *block)
+{
+    const size_t osize = block->b_osize;
+    const size_t usable = block->b_nblocks * ETS_BLOCK_SIZE - ETS_BLOCK_HEADER_SIZE;
+    const size_t nwords = (usable / osize + 63) / 64;
+    const size_t bitmaps = 2 * ets_block_bitmap_bytes (nwords);
+    block->b_bmwords = nwords;
+    block->b_ocnt = (usable - bitmaps) / osize;
+    block->b_objoff = bitmaps + ets_block_color (block, usable - bitmaps - block->b_ocnt * osize);
+    block->b_bmhint = 0;
+    block->b_pfl = nullptr;
+    block->b_ncarved = block->b_ocnt;
+
+    uint64_t *const pbm = ets_block_pbm (block);
+    uint64_t *const gbm = ets_block_gbm (block);
+    for (size_t w = 0; w < nwords; ++w) {
+        const size_t lo = w * 64;
+        pbm[w] = lo >= block->b_ocnt       ? 0
+                 : block->b_ocnt - lo >= 64 ? ~(uint64_t)0
+                                            : ((uint64_t)1 << (block->b_ocnt - lo)) - 1;
+        __atomic_store_n (&gbm[w], 0, __ATOMIC_SEQ_CST);
+    }
     return E_OK;
 }
 
+//! Fold the remote bitmap into the private one; false if it was empty.
+//! Thread-safe: OWNING
+static bool ets_block_bitmap_collect (ets_block_t *block)
+{
+    uint64_t *const pbm = ets_block_pbm (block);
+    uint64_t *const gbm = ets_block_gbm (block);
+    bool any = false;
+    for (size_t w = 0; w < block->b_bmwords; ++w) {
+        if (__atomic_load_n (&gbm[w], __ATOMIC_RELAXED)) {
+            pbm[w] |= __atomic_exchange_n (&gbm[w], 0, __ATOMIC_SEQ_CST);
+            if (!any) {
+                block->b_bmhint = w;
+                any = true;
+            }
+        }
+    }
+    return any;
+}
+
+//! Take the lowest free object of a bitmap block, or nullptr if there is
+//! none. Object memory is not touched.
+//! Thread-safe: OWNING
+static inline void *ets_block_bitmap_take (ets_block_t *block)
+{
+    uint64_t *const pbm = ets_block_pbm (block);
+    do {
+        for (size_t w = block->b_bmhint; w < block->b_bmwords; ++w) {
+            const uint64_t word = pbm[w];
+            if (word) {
+                pbm[w] = word & (word - 1);
+                block->b_bmhint = w;
+                return ets_block_objects (block) + (w * 64 + __builtin_ctzll (word)) * block->b_osize;
+            }
+        }
+        block->b_bmhint = block->b_bmwords;
+    } while (ets_block_bitmap_collect (block));
+    return nullptr;
+}
+
+//! Mark a chain of objects free: in the private bitmap if we own the block,
+//! with one atomic OR per word of the remote bitmap otherwise.
+//! Thread-safe: 1
+static inline size_t ets_block_bitmap_index (ets_block_t *block, void *object)
+{
+    const uint64_t offset = (uint8_t *)object - ets_block_objects (block);
+    return (offset * block->b_osize_recip) >> 32;
+}
+
+static inline void ets_block_bitmap_release_word (ets_block_t *block, size_t w, uint64_t mask, bool owner)
+{
+    if (owner) {
+        ets_block_pbm (block)[w] |= mask;
+        if (w < block->b_bmhint) {
+            block->b_bmhint = w;
+        }
+    } else {
+        __atomic_fetch_or (&ets_block_gbm (block)[w], mask, __ATOMIC_SEQ_CST);
+    }
+}
+
+static void ets_block_bitmap_release_chain (ets_block_t *block, void *first, size_t count)
+{
+    const bool owner = ets_tid () == __atomic_load_n (&block->b_owning_tid, __ATOMIC_SEQ_CST);
+    if (count == 1) {
+        const size_t idx = ets_block_bitmap_index (block, first);
+        ets_block_bitmap_release_word (block, idx / 64, (uint64_t)1 << (idx % 64), owner);
+        return;
+    }
+
+    uint64_t masks[ETS_BITMAP_MAX_WORDS] = {};
+    size_t lo = block->b_bmwords, hi = 0;
+    void *object = first;
+    for (size_t i = 0; i < count; ++i, object = (i < count ? *(void **)object : nullptr)) {
+        const size_t idx = ets_block_bitmap_index (block, object);
+        masks[idx / 64] |= (uint64_t)1 << (idx % 64);
+        if (idx / 64 < lo) lo = idx / 64;
+        if (idx / 64 >= hi) hi = idx / 64 + 1;
+    }
+    for (size_t w = hi; w-- > lo;) {
+        if (masks[w]) {
+            ets_block_bitmap_release_word (block, w, masks[w], owner);
+        }
+    }
+}
+#endif
+
+static inline bool ets_block_has_free (ets_block_t *block)
+{
+    if (ETS_BLFL_LIFTING & __atomic_load_n (&block->b_flags, __ATOMIC_SEQ_CST)) {
+        return false;
+    }
+    if (nullptr != __atomic_load_n (&block->b_gfl, __ATOMIC_SEQ_CST)
+        || nullptr != __atomic_load_n (&block->b_pfl, __ATOMIC_SEQ_CST)) {
+        return true;
+    }
+#if ETS_FEATURE_BITMAP_BLOCKS
+    const uint64_t *const pbm = ets_block_pbm (block);
+    const uint64_t *const gbm = ets_block_gbm (block);
+    for (size_t w = 0; w < block->b_bmwords; ++w) {
+        if (__atomic_load_n (&pbm[w], __ATOMIC_RELAXED) || __atomic_load_n (&gbm[w], __ATOMIC_RELAXED)) {
+            return true;
+        }
+    }
+#endif
+    return false;
+}
+
 static int ets_block_format_to_size (ets_block_t *block, size_t osize)
 {
     PRECONDITION ("block must be locked");
     uint8_t *memory = ((ets_opaque_block_t *)block)->b_memory;
-    block->b_pfl = memory;
     __atomic_store_n (&block->b_gfl, nullptr, __ATOMIC_SEQ_CST);
     block->b_osize = osize;
-    block->b_ocnt = (ETS_BLOCK_SIZE - sizeof (ets_block_t)) / osize;
+    block->b_ocnt = (block->b_nblocks * ETS_BLOCK_SIZE - ETS_BLOCK_HEADER_SIZE) / osize;
     __atomic_store_n (&block->b_flags, 0, __ATOMIC_SEQ_CST);
     __atomic_store_n (&block->b_acnt, 0, __ATOMIC_SEQ_CST);
+    block->b_osize_recip = (uint32_t)((((uint64_t)1 << 32) + osize - 1) / osize);
     CTX ("ets_block_format_to_size called with block=%p, osize=%zu\n"
          " | memory=%p (+%p) | ocnt = %zu",
          block, osize, memory, (memory - (uint8_t *)block), block->b_ocnt)
 
+#if ETS_FEATURE_BITMAP_BLOCKS
+    block->b_bmwords = 0;
+    if (osize <= ETS_BITMAP_MAX_OSIZE) {
+        return ets_block_format_bitmap (block);
+    }
+#endif
+    block->b_objoff = ets_block_color (
+        block, block->b_nblocks * ETS_BLOCK_SIZE - ETS_BLOCK_HEADER_SIZE - block->b_ocnt * osize);
+    memory += block->b_objoff;
+#if ETS_FEATURE_LAZY_CARVING
+    /* nothing is written to object memory until it is handed out. A block
+     * only ever leaves the head of its linkage once allocation from it has
+     * failed, which includes carving, so blocks anywhere else are fully
+     * carved and "both free lists empty" still means "no free objects" */
+    block->b_pfl = nullptr;
+    block->b_ncarved = 0;
+#else
+    block->b_pfl = memory;
+    block->b_ncarved = block->b_ocnt;
     size_t i;
     for (i = 0; i < block->b_ocnt; ++i) {
         *(void **)(memory + i * osize) = &memory[(i + 1) * osize];
@@ -1196,10 +2462,74 @@ static int ets_block_format_to_size (ets_block_t *block, size_t osize)
     }
     *(void **)(memory + (i - 1) * osize) = nullptr;
     //printf ("rewrote %p -> %p\n", &memory[i * osize - osize], *(void **)(memory + i * osize - osize));
+#endif
 
     return E_OK;
 }
 
+static size_t ets_span_nblocks (size_t lkgi)
+{
+    if (lkgi < ETS_LKGI_MEDIUM) return 1;
+    /* shortest run that wastes no more than an eighth of itself */
+    const size_t osize = ets_rlup_sli (lkgi);
+    size_t nblocks;
+    for (nblocks = 1; nblocks < ETS_SPAN_MAX_NBLOCKS; ++nblocks) {
+        const size_t usable = nblocks * ETS_BLOCK_SIZE - ETS_BLOCK_HEADER_SIZE;
+        if (usable >= osize
+            && 8 * (usable % osize + ETS_BLOCK_HEADER_SIZE) <= nblocks * ETS_BLOCK_SIZE)
+            break;
+    }
+    return nblocks;
+}
+
+//! `b_gfl` is a LIFO that remote threads only ever push onto, and that is
+//! only ever emptied all at once, so there is no ABA to guard against.
+static inline void ets_block_gfl_push (ets_block_t *block, void *object)
+{
+    ets_block_gfl_push_chain (block, object, object);
+}
+
+static inline void ets_block_gfl_push_chain (ets_block_t *block, void *first, void *last)
+{
+    void *head = __atomic_load_n (&block->b_gfl, __ATOMIC_SEQ_CST);
+    do {
+        *(void **)last = head;
+    } while (!__atomic_compare_exchange_n (&block->b_gfl, &head, first, true,
+                                           __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST));
+}
+
+static inline void *ets_block_gfl_collect (ets_block_t *block)
+{
+    return __atomic_exchange_n (&block->b_gfl, nullptr, __ATOMIC_SEQ_CST);
+}
+
+//! The next never-used object of a block, or nullptr if all have been carved.
+//! Thread-safe: OWNING
+static inline void *ets_block_carve (ets_block_t *block)
+{
+    if (block->b_ncarved == block->b_ocnt) {
+        return nullptr;
+    }
+    return ets_block_objects (block) + (size_t)block->b_ncarved++ * block->b_osize;
+}
+
+//! Carve every never-used object of a block onto its private free list at
+//! once, for a block that goes right of head without passing through the
+//! head first; bitmap blocks have nothing left to carve.
+//! Thread-safe: OWNING
+static void ets_block_carve_all (ets_block_t *block)
+{
+    uint8_t *const objects = ets_block_objects (block);
+    void *pfl = block->b_pfl;
+    for (size_t i = block->b_ocnt; i > block->b_ncarved; --i) {
+        void *const object = objects + (i - 1) * block->b_osize;
+        *(void **)object = pfl;
+        pfl = object;
+    }
+    block->b_pfl = pfl;
+    block->b_ncarved = block->b_ocnt;
+}
+
 static inline int ets_block_alloc_object_impl (ets_block_t *block, void **object)
 {
     (*object) = block->b_pfl;
@@ -1216,149 +2546,452 @@ static int ets_block_alloc_object (ets_block_t *block, void **object)
          " | pfl=%p | acnt=%zu/%zu",
          block, object, block->b_pfl, __atomic_load_n (&block->b_acnt, __ATOMIC_SEQ_CST),
          block->b_ocnt)
+#if ETS_FEATURE_BITMAP_BLOCKS
+    if (block->b_bmwords) {
+        (*object) = ets_block_bitmap_take (block);
+        if (UNLIKELY ((*object) == nullptr)) {
+            return E_BL_EMPTY;
+        }
+        __atomic_add_fetch (&block->b_acnt, 1, __ATOMIC_SEQ_CST);
+        return E_OK;
+    }
+#endif
     if (block->b_pfl != nullptr) {
         return ets_block_alloc_object_impl (block, object);
     } else {
-        ets_mutex_lock (&block->b_access);
-        /* not actually atomic, just needed an XCHG instruction */
-        block->b_pfl = __atomic_exchange_n (&block->b_gfl, nullptr, __ATOMIC_SEQ_CST);
-        ets_mutex_unlock (&block->b_access);
+        block->b_pfl = ets_block_gfl_collect (block);
         CTX ("swapped null pfl for gfl; now pfl=%p", block->b_pfl)
 
         if (LIKELY (block->b_pfl != nullptr)) {
             return ets_block_alloc_object_impl (block, object);
         }
+        (*object) = ets_block_carve (block);
+        if ((*object) != nullptr) {
+            __atomic_add_fetch (&block->b_acnt, 1, __ATOMIC_SEQ_CST);
+            return E_OK;
+        }
         return E_BL_EMPTY;
     }
 }
 
-static int ets_block_dealloc_object (ets_block_t *block, void *object)
+static size_t ets_block_alloc_chain (ets_block_t *block, size_t want, void **firstp, void **lastp)
 {
-    CTXUP ("ets_block_dealloc_object called with block=%p, object=%p\n"
-           " | acnt = %hu/%hu | flags = %hhu | osize = %hu",
-           block, object, __atomic_load_n (&block->b_acnt, __ATOMIC_SEQ_CST),
-           block->b_ocnt, block->b_flags, block->b_osize)
-
-    if (ets_tid () == __atomic_load_n (&block->b_owning_tid, __ATOMIC_SEQ_CST)) {
-        *(void **)object = block->b_pfl;
-        block->b_pfl = object;
-    } else {
-        ets_mutex_lock (&block->b_access);
-        *(void **)object = block->b_gfl;
-        block->b_gfl = object;
-        ets_mutex_unlock (&block->b_access);
-    }
-
-    const size_t acnt_cache = __atomic_sub_fetch (&block->b_acnt, 1, __ATOMIC_SEQ_CST);
-    if (0 == acnt_cache) {
-        ets_mutex_lock (&block->b_access);
-        if (!(ETS_BLFL_HEAD & __atomic_load_n (&block->b_flags, __ATOMIC_SEQ_CST))) {
-            if (0 == __atomic_load_n (&block->b_acnt, __ATOMIC_SEQ_CST)) {
-                void *pfl_save = block->b_pfl,
-                     *gfl_save = block->b_gfl;
-                block->b_pfl = nullptr;
-                block->b_gfl = nullptr;
-                ets_mutex_unlock (&block->b_access);
-
-                ets_lkg_t *const lkg_cache = __atomic_load_n (&block->b_owning_lkg, __ATOMIC_SEQ_CST);
-                ets_mutex_lock (&lkg_cache->l_access);
-                ets_mutex_lock (&block->b_access);
-                block->b_pfl = pfl_save;
-                block->b_gfl = gfl_save;
-
-                const int r = ets_lkg_block_did_become_empty (lkg_cache, block);
-                CTXDOWN ("ets_lkg_block_did_become_empty returned %i", r)
-                return r;
+#if ETS_FEATURE_BITMAP_BLOCKS
+    if (block->b_bmwords) {
+        void *first = nullptr, *last = nullptr, *object;
+        size_t n;
+        for (n = 0; n < want && (object = ets_block_bitmap_take (block)); ++n) {
+            if (last) {
+                *(void **)last = object;
             } else {
-                ets_mutex_unlock (&block->b_access);
-                CTXDOWN ("couldn't lift: spurious empty on %p", block)
-                return E_OK;
+                first = object;
             }
-        } else {
-            ets_mutex_unlock (&block->b_access);
-            CTXDOWN ("couldn't lift: head")
-            return E_OK;
-        }
-    } else if (acnt_cache == (block->b_ocnt / 2)) {
-        if (ETS_BLFL_ROH & __atomic_load_n (&block->b_flags, __ATOMIC_SEQ_CST)) {
-            CTXDOWN ("couldn't right: ROH set")
-            return E_OK;
+            last = object;
         }
-        ets_mutex_lock (&block->b_access);
-        if (ETS_BLFL_ROH & __atomic_load_n (&block->b_flags, __ATOMIC_SEQ_CST)) {
-            ets_mutex_unlock (&block->b_access);
-            CTXDOWN ("couldn't right: spurious ROH")
-            return E_OK;
+        if (n) {
+            __atomic_add_fetch (&block->b_acnt, n, __ATOMIC_SEQ_CST);
         }
-        if (!__atomic_test_and_set (&block->b_flisroh, __ATOMIC_SEQ_CST)) {
-            ets_mutex_unlock (&block->b_access);
-            CTXDOWN ("couldn't right: being righted")
-            return E_OK;
+        (*firstp) = first;
+        (*lastp) = last;
+        return n;
+    }
+#endif
+    if (!block->b_pfl) {
+        block->b_pfl = ets_block_gfl_collect (block);
+    }
+    void *first = block->b_pfl;
+    void *last = nullptr;
+    size_t n;
+    for (n = 0; n < want && block->b_pfl; ++n) {
+        last = block->b_pfl;
+        block->b_pfl = *(void **)last;
+    }
+    /* then whatever the free lists could not cover from untouched memory */
+    for (void *carved; n < want && (carved = ets_block_carve (block)); ++n) {
+        if (last) {
+            *(void **)last = carved;
+        } else {
+            first = carved;
         }
-        if (!__atomic_load_n (&block->b_acnt, __ATOMIC_SEQ_CST)) {
-            ets_mutex_unlock (&block->b_access);
-            __atomic_clear (&block->b_flisroh, __ATOMIC_SEQ_CST);
-            CTXDOWN ("couldn't right: zeroed")
-            return E_OK;
+        last = carved;
+    }
+    if (n) {
+        __atomic_add_fetch (&block->b_acnt, n, __ATOMIC_SEQ_CST);
+    }
+    CTX ("ets_block_alloc_chain: took %zu/%zu objects from block=%p", n, want, block)
+    (*firstp) = first;
+    (*lastp) = last;
+    return n;
+}
+
+static int ets_block_dealloc_object (ets_block_t *block, void *object)
+{
+    CTX ("ets_block_dealloc_object called with block=%p, object=%p\n"
+         " | acnt = %hu/%hu | flags = %hhu | osize = %hu",
+         block, object, __atomic_load_n (&block->b_acnt, __ATOMIC_SEQ_CST),
+         block->b_ocnt, block->b_flags, block->b_osize)
+
+    return ets_block_dealloc_chain (block, object, object, 1);
+}
+
+static int ets_block_dealloc_chain (ets_block_t *block, void *first, void *last, size_t count)
+{
+#if ETS_FEATURE_BITMAP_BLOCKS
+    if (block->b_bmwords) {
+        ets_block_bitmap_release_chain (block, first, count);
+    } else
+#endif
+        if (ets_tid () == __atomic_load_n (&block->b_owning_tid, __ATOMIC_SEQ_CST)) {
+        *(void **)last = block->b_pfl;
+        block->b_pfl = first;
+    } else {
+        ets_block_gfl_push_chain (block, first, last);
+    }
+
+    /* a release that takes the block below half, or empties it, keeps one of
+     * its objects counted until the block is righted or lifted: it cannot be
+     * lifted and reused under it in the meantime, and no other release can
+     * empty it too */
+    const size_t half = block->b_ocnt / 2u;
+    uint16_t acnt_cache = __atomic_load_n (&block->b_acnt, __ATOMIC_SEQ_CST);
+    bool pinned;
+    do {
+        pinned = acnt_cache == count || (acnt_cache > half && acnt_cache - count <= half);
+    } while (!__atomic_compare_exchange_n (&block->b_acnt, &acnt_cache, (uint16_t)(acnt_cache - count + pinned),
+                                           true, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST));
+    return ets_block_did_release (block, acnt_cache - count, count, pinned);
+}
+
+//! Lock the linkage `block` belongs to. The block may move between loading
+//! `b_owning_lkg` and taking the lock, so it is loaded again under the lock
+//! until the two agree; the caller must keep the block from being lifted.
+//! Thread-safe: 1
+static ets_lkg_t *ets_block_lock_owning_lkg (ets_block_t *block)
+{
+    for (;;) {
+        ets_lkg_t *const lkg_cache = __atomic_load_n (&block->b_owning_lkg, __ATOMIC_SEQ_CST);
+        ets_mutex_lock (&lkg_cache->l_access);
+        /* once linkage is locked, block's linkage affiliation will *not* change */
+        if (LIKELY (lkg_cache == __atomic_load_n (&block->b_owning_lkg, __ATOMIC_SEQ_CST))) {
+            return lkg_cache;
+        }
+        ets_mutex_unlock (&lkg_cache->l_access);
+    }
+}
+
+//! Drop the object a release kept counted, unless it is the last one.
+//! Returns whether it was, in which case the caller still holds the pin.
+//! Thread-safe: 1
+static bool ets_block_unpin (ets_block_t *block)
+{
+    uint16_t acnt_cache = __atomic_load_n (&block->b_acnt, __ATOMIC_SEQ_CST);
+    do {
+        if (1 == acnt_cache) {
+            return 1;
         }
-        /* concurrent accesses possible: allocation path */
+    } while (!__atomic_compare_exchange_n (&block->b_acnt, &acnt_cache, (uint16_t)(acnt_cache - 1), true,
+                                           __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST));
+    return 0;
+}
+
+//! Lift a block whose last object was just released, unless it is the head
+//! or got an object back. The caller pinned the block by keeping that object
+//! counted, so that no other release can lift it too.
+//! Thread-safe: 1
+static int ets_block_did_empty (ets_block_t *block)
+{
+    for (;;) {
+        ets_mutex_lock (&block->b_access);
         const uint16_t flag_cache = __atomic_load_n (&block->b_flags, __ATOMIC_SEQ_CST);
-        if (!(ETS_BLFL_HEAD & flag_cache) && (ETS_BLFL_IN_THEATRE & flag_cache)) {
-            /*
-             * @TODO: MAJOR ISSUES:
-             *  - MULTIPLE PARTIALS
-             *  - PARTIAL | ZERO
-             */
-            if ((block->b_ocnt / 2) >= __atomic_load_n (&block->b_acnt, __ATOMIC_SEQ_CST)) {
-                void *pfl_save = block->b_pfl;
-                void *gfl_save = block->b_gfl;
-                block->b_pfl = nullptr;
-                block->b_gfl = nullptr;
-                ets_mutex_unlock (&block->b_access);
-
-                /* issue: if a head transfer op is in progress
-                 * possible situations:
-                 *  - NOT a slide
-                 *  - CANT be a pull
-                 */
-                ets_lkg_t *lkg_cache;
-                do {
-                    lkg_cache = __atomic_load_n (&block->b_owning_lkg, __ATOMIC_SEQ_CST);
-                    /* @TODO: MAJOR ISSUE:
-                     *  - COULD THE LINKAGE CHANGE HERE? */
-                    ets_mutex_lock (&lkg_cache->l_access);
-                    /* once linkage is locked, block's linkage affiliation will *not* change */
-                    if (LIKELY (lkg_cache == __atomic_load_n (&block->b_owning_lkg, __ATOMIC_SEQ_CST))) {
-                        break;
-                    }
-                    ets_mutex_unlock (&lkg_cache->l_access);
-                } while (1);
-                ets_mutex_lock (&block->b_access);
-                block->b_pfl = pfl_save;
-                block->b_gfl = gfl_save;
-
-                /* clears FLISROH */
-                const int r = ets_lkg_block_did_become_partially_empty (lkg_cache, block);
-                CTXDOWN ("ets_lkg_block_did_become_partially_empty returned %i", r)
-                return r;
-            } else {
-                ets_mutex_unlock (&block->b_access);
-                __atomic_clear (&block->b_flisroh, __ATOMIC_SEQ_CST);
-                CTXDOWN ("couldn't right block: spurious acnt increase")
-                return E_OK;
-            }
-        } else {
+        if (flag_cache & (ETS_BLFL_HEAD | ETS_BLFL_LIFTING)) {
+            /* the owner may allocate from the head without its lock */
+            __atomic_sub_fetch (&block->b_acnt, 1, __ATOMIC_SEQ_CST);
             ets_mutex_unlock (&block->b_access);
-            __atomic_clear (&block->b_flisroh, __ATOMIC_SEQ_CST);
-            CTXDOWN ("couldn't right block: head or out-of-theatre")
+            CTX ("couldn't lift %p: head, or already lifting", block)
+            return E_OK;
+        }
+        if (1 == __atomic_load_n (&block->b_acnt, __ATOMIC_SEQ_CST)) {
+            break;
+        }
+        ets_mutex_unlock (&block->b_access);
+        /* whoever took objects out will empty it again when they are back */
+        if (!ets_block_unpin (block)) {
+            CTX ("couldn't lift: spurious empty on %p", block)
             return E_OK;
         }
     }
+    /* hide the free lists so that a slide cauterizes the block rather than
+     * promoting it; with every object free, nothing can be pushed onto them
+     * in the meantime */
+    void *pfl_save = block->b_pfl,
+         *gfl_save = ets_block_gfl_collect (block);
+    block->b_pfl = nullptr;
+    __atomic_or_fetch (&block->b_flags, ETS_BLFL_LIFTING, __ATOMIC_SEQ_CST);
+    ets_mutex_unlock (&block->b_access);
+
+    /* LIFTING keeps every slide off the block */
+    ets_lkg_t *const lkg_cache = ets_block_lock_owning_lkg (block);
+    ets_mutex_lock (&block->b_access);
+    block->b_pfl = pfl_save;
+    __atomic_store_n (&block->b_gfl, gfl_save, __ATOMIC_SEQ_CST);
+    __atomic_and_fetch (&block->b_flags, ~ETS_BLFL_LIFTING, __ATOMIC_SEQ_CST);
+    __atomic_store_n (&block->b_acnt, 0, __ATOMIC_SEQ_CST);
+
+    return ets_lkg_block_did_become_empty (lkg_cache, block);
+}
+
+//! Move a block that just fell below half right of head, where slides find
+//! it. The caller pinned the block by keeping one object counted.
+//! Thread-safe: 1
+static int ets_block_did_fall_below_half (ets_block_t *block)
+{
+    if (ETS_BLFL_ROH & __atomic_load_n (&block->b_flags, __ATOMIC_SEQ_CST)) {
+        CTX ("couldn't right %p: ROH set", block)
+        return E_OK;
+    }
+    ets_mutex_lock (&block->b_access);
+    if (ETS_BLFL_ROH & __atomic_load_n (&block->b_flags, __ATOMIC_SEQ_CST)) {
+        ets_mutex_unlock (&block->b_access);
+        CTX ("couldn't right %p: spurious ROH", block)
+        return E_OK;
+    }
+    if (__atomic_test_and_set (&block->b_flisroh, __ATOMIC_SEQ_CST)) {
+        ets_mutex_unlock (&block->b_access);
+        CTX ("couldn't right %p: being righted", block)
+        return E_OK;
+    }
+    /* concurrent accesses possible: allocation path */
+    const uint16_t flag_cache = __atomic_load_n (&block->b_flags, __ATOMIC_SEQ_CST);
+    if ((ETS_BLFL_HEAD & flag_cache) || !(ETS_BLFL_IN_THEATRE & flag_cache)) {
+        ets_mutex_unlock (&block->b_access);
+        __atomic_clear (&block->b_flisroh, __ATOMIC_SEQ_CST);
+        CTX ("couldn't right %p: head or out-of-theatre", block)
+        return E_OK;
+    }
+    /* the free lists stay in place: the block is left of head, where slides
+     * never look, and frees keep landing on them (b_pfl belongs to the owner,
+     * who may not be us) */
+    ets_mutex_unlock (&block->b_access);
+
+    ets_lkg_t *const lkg_cache = ets_block_lock_owning_lkg (block);
+    ets_mutex_lock (&block->b_access);
+    /* a slide may have made it the head meanwhile */
+    if (ETS_BLFL_HEAD & __atomic_load_n (&block->b_flags, __ATOMIC_SEQ_CST)) {
+        ets_mutex_unlock (&block->b_access);
+        ets_mutex_unlock (&lkg_cache->l_access);
+        __atomic_clear (&block->b_flisroh, __ATOMIC_SEQ_CST);
+        CTX ("couldn't right %p: became head", block)
+        return E_OK;
+    }
+
+    /* clears FLISROH */
+    return ets_lkg_block_did_become_partially_empty (lkg_cache, block);
+}
+
+static int ets_block_did_release (ets_block_t *block, size_t acnt_cache, size_t nreleased, bool pinned)
+{
+    CTXUP ("ets_block_did_release called with block=%p, acnt=%zu/%hu, nreleased=%zu, pinned=%i",
+           block, acnt_cache, block->b_ocnt, nreleased, (int)pinned)
+
+    if (!pinned) {
+        CTXDOWN ("successful")
+        return E_OK;
+    }
+    if (0 != acnt_cache) {
+        const int r = ets_block_did_fall_below_half (block);
+        if (E_OK != r || !ets_block_unpin (block)) {
+            CTXDOWN ("righting returned %i", r)
+            return r;
+        }
+        /* the pin was the last object */
+    }
+    const int r = ets_block_did_empty (block);
+    CTXDOWN ("ets_block_did_empty returned %i", r)
+    return r;
+}
+
+/* SECTION: REMOTE FREES */
+
+//! Frees this thread made to blocks it does not own, not yet handed over.
+static _Thread_local ets_rfb_t _ETS_rfb;
+
+static inline ets_rfb_group_t *ets_rfb_group_for (ets_rfb_group_t *groups, ets_block_t *block)
+{
+    return &groups[((uintptr_t)block / ETS_BLOCK_SIZE) % ETS_RFB_NGROUPS];
+}
+
+static int ets_rfb_flush_group (ets_rfb_group_t *group)
+{
+    ets_block_t *const block = group->rg_block;
+    const size_t count = group->rg_count;
+    CTX ("ets_rfb_flush_group: %zu objects to block=%p", count, block)
+    group->rg_block = nullptr;
+    group->rg_count = 0;
+
+    /* the buffered objects still count as allocated, so the block cannot have
+     * been lifted or reformatted in the meantime; who owns it is read again by
+     * ets_block_dealloc_chain, as it may have changed hands since */
+    return ets_block_dealloc_chain (block, group->rg_first, group->rg_last, count);
+}
+
+//! Add an object to a group, first flushing whatever other block's objects
+//! the group held.
+static inline void ets_rfb_group_add (ets_rfb_group_t *group, ets_block_t *block, void *object)
+{
+    if (group->rg_block != block) {
+        if (group->rg_block) {
+            ets_rfb_flush_group (group);
+        }
+        group->rg_block = block;
+        group->rg_first = nullptr;
+        group->rg_last = object;
+    }
+    *(void **)object = group->rg_first;
+    group->rg_first = object;
+    ++group->rg_count;
+}
+
+static bool ets_rfb_defer (ets_block_t *block, void *object)
+{
+    ets_rfb_t *const rfb = &_ETS_rfb;
+    if (UNLIKELY (ETS_RFB_ARMED != rfb->rfb_state)) {
+        if (ETS_RFB_RETIRED == rfb->rfb_state) {
+            return false;
+        }
+        /* the buffer is drained when the thread's heap is abandoned, so even
+         * a thread that only ever frees needs one */
+        ets_heap_ensure_local ();
+        rfb->rfb_state = ETS_RFB_ARMED;
+    }
+
+    ets_rfb_group_t *const group = ets_rfb_group_for (rfb->rfb_groups, block);
+    ets_rfb_group_add (group, block, object);
+    if (group->rg_count >= ETS_RFB_FLUSH_THRESHOLD || 4 * group->rg_count >= block->b_ocnt) {
+        ets_rfb_flush_group (group);
+    }
+    return true;
+}
+
+static int ets_block_release_object (ets_block_t *block, void *object)
+{
+#if ETS_FEATURE_REMOTE_FREE_BUFFER
+    if (ets_tid () != __atomic_load_n (&block->b_owning_tid, __ATOMIC_SEQ_CST)
+        && ets_rfb_defer (block, object)) {
+        return E_OK;
+    }
+#endif
+    return ets_block_dealloc_object (block, object);
+}
+
+static int ets_rfb_flush (ets_rfb_t *rfb)
+{
+    int r = E_OK;
+    for (size_t i = 0; i < ETS_RFB_NGROUPS; ++i) {
+        if (rfb->rfb_groups[i].rg_block) {
+            const int gr = ets_rfb_flush_group (&rfb->rfb_groups[i]);
+            if (E_OK != gr) r = gr;
+        }
+    }
+    return r;
+}
+
+/* SECTION: TCACHE */
+
+namespace ets::alloc::heap_detail {
+    constinit thread_local ets_tcache_t _ETS_tcache = {};
+}
+
+//! Return the `count` least recently freed objects of a bin to their blocks;
+//! the rest are likelier to still be in cache.
+static void ets_tcache_drain (ets_tcache_bin_t *bin, size_t count)
+{
+    void *object;
+    if (count >= bin->tb_count) {
+        object = bin->tb_head;
+        bin->tb_head = nullptr;
+        bin->tb_count = 0;
+    } else {
+        void *keep_last = bin->tb_head;
+        for (size_t i = 1; i < bin->tb_count - count; ++i) {
+            keep_last = *(void **)keep_last;
+        }
+        object = *(void **)keep_last;
+        *(void **)keep_last = nullptr;
+        bin->tb_count -= count;
+    }
+    CTX ("ets_tcache_drain: returning %zu objects, %zu left", count, bin->tb_count)
+    /* objects freed together tend to share a block: hand back each run as
+     * one chain */
+    while (object) {
+        ets_block_t *const block = ets_get_block_for_object (object);
+        void *const first = object;
+        void *last;
+        size_t n = 0;
+        do {
+            last = object;
+            object = *(void **)object;
+            ++n;
+        } while (object && ets_get_block_for_object (object) == block);
+        ets_block_dealloc_chain (block, first, last, n);
+    }
+}
+
+static bool ets_tcache_push (ets_tcache_t *tc, size_t lkgi, void *object)
+{
+    if (UNLIKELY (ETS_TCACHE_ARMED != tc->tc_state)) {
+        if (ETS_TCACHE_RETIRED == tc->tc_state) {
+            return false;
+        }
+        /* like the remote free buffer, the cache is drained on thread exit
+         * by the heap's destructor */
+        ets_heap_ensure_local ();
+        tc->tc_state = ETS_TCACHE_ARMED;
+    }
+    ets_tcache_bin_t *const bin = &tc->tc_bins[lkgi];
+    if (UNLIKELY (bin->tb_count >= ets_tcache_bin_capacity (lkgi))) {
+        ets_tcache_drain (bin, bin->tb_count / 2);
+    }
+    *(void **)object = bin->tb_head;
+    bin->tb_head = object;
+    ++bin->tb_count;
+    return true;
+}
+
+static int ets_tcache_refill (ets_tcache_t *tc, ets_heap_t *heap, size_t lkgi, void **object)
+{
+    ets_lkg_t *const lkg = &heap->h_lkgs[lkgi];
+    const int r = ets_lkg_alloc_object (lkg, heap, object);
+    if (E_OK != r || ETS_TCACHE_RETIRED == tc->tc_state) {
+        return r;
+    }
+    tc->tc_state = ETS_TCACHE_ARMED;
 
-    CTXDOWN ("successful")
+    /* the object came off the head block, whose private free list is ours;
+     * take up to half a bin more from it */
+    ets_tcache_bin_t *const bin = &tc->tc_bins[lkgi];
+    const size_t want = ets_tcache_bin_capacity (lkgi) / 2;
+    if (bin->tb_count >= want) {
+        return E_OK;
+    }
+    void *first, *last;
+    const size_t n = ets_block_alloc_chain (__atomic_load_n (&lkg->l_active, __ATOMIC_SEQ_CST),
+                                            want - bin->tb_count, &first, &last);
+    if (n) {
+        *(void **)last = bin->tb_head;
+        bin->tb_head = first;
+        bin->tb_count += n;
+    }
+    CTX ("ets_tcache_refill: bin %zu holds %zu objects", lkgi, bin->tb_count)
     return E_OK;
 }
 
+static void ets_tcache_flush (ets_tcache_t *tc)
+{
+    for (size_t lkgi = 1; lkgi < ETS_TCACHE_NBINS; ++lkgi) {
+        ets_tcache_drain (&tc->tc_bins[lkgi], tc->tc_bins[lkgi].tb_count);
+    }
+}
+
 /* SECTION: LINKAGE */
 
 static int ets_lkg_init (ets_lkg_t *lkg, size_t lkgi, ets_heap_t *heap)
@@ -1366,8 +2999,9 @@ static int ets_lkg_init (ets_lkg_t *lkg, size_t lkgi, ets_heap_t *heap)
     lkg->l_index = lkgi;
     lkg->l_owning_heap = heap;
     lkg->l_nblocks = 0;
+    lkg->l_nreserved = 0;
     lkg->l_active = nullptr;
-    pthread_mutex_init (&lkg->l_access, nullptr);
+    ets_lock_init (&lkg->l_access);
 
     return E_OK;
 }
@@ -1387,6 +3021,7 @@ static int ets_lkg_alloc_object (ets_lkg_t *lkg, ets_heap_t *heap, void **object
         ets_block_t *tmp;
         r = ets_lkg_req_block_from_heap (heap, lkg->l_index, &tmp);
         if (E_OK != r) {
+            ets_mutex_unlock (&lkg->l_access);
             CTXDOWN ("ets_lkg_req_block_from_heap failed with error code %i", r)
             return r;
         }
@@ -1399,6 +3034,7 @@ static int ets_lkg_alloc_object (ets_lkg_t *lkg, ets_heap_t *heap, void **object
         tmp->b_next = nullptr;
         tmp->b_prev = nullptr;
         __atomic_store_n (&lkg->l_active, tmp, __ATOMIC_SEQ_CST);
+        ++lkg->l_nblocks;
 
         ets_mutex_unlock (&tmp->b_access);
 
@@ -1428,8 +3064,7 @@ static int ets_lkg_alloc_object (ets_lkg_t *lkg, ets_heap_t *heap, void **object
         for (;;) {
             ets_mutex_lock (&block_cache->b_next->b_access);
 
-            if (nullptr == block_cache->b_next->b_gfl
-                && nullptr == block_cache->b_next->b_pfl
+            if (!ets_block_has_free (block_cache->b_next)
             /* double null free lists will ONLY occur naturally in
                      * head or left-of-head blocks */
 #if 0
@@ -1444,39 +3079,43 @@ static int ets_lkg_alloc_object (ets_lkg_t *lkg, ets_heap_t *heap, void **object
                 /* cauterize - optional, but makes things easier*/
                 liftee->b_next = nullptr;
                 liftee->b_prev = nullptr;
+                --lkg->l_nblocks;
 
                 ets_mutex_unlock (&liftee->b_access);
                 LOG ("cauterizd block %p, moving on", liftee)
+                /* the head stays put; its new neighbour is the next candidate */
                 if (block_cache->b_next == nullptr) {
                     is_slideable = 0;
                     break;
                 }
-                block_cache = block_cache->b_next;
             } else {
                 /* 0T being lifted */
                 break;
             }
         }
         if (1 == is_slideable) {
-            LOG ("sliding block %p", block_cache->b_next)
+            /* the links may change as soon as the locks go */
+            ets_block_t *const promotee = block_cache->b_next;
+            LOG ("sliding block %p", promotee)
             __atomic_and_fetch (&block_cache->b_flags, ~ETS_BLFL_HEAD, __ATOMIC_SEQ_CST);
-            __atomic_or_fetch (&block_cache->b_next->b_flags, ETS_BLFL_HEAD | ETS_BLFL_IN_THEATRE, __ATOMIC_SEQ_CST);
-            __atomic_and_fetch (&block_cache->b_next->b_flags, ~ETS_BLFL_ROH, __ATOMIC_SEQ_CST);
+            __atomic_or_fetch (&promotee->b_flags, ETS_BLFL_HEAD | ETS_BLFL_IN_THEATRE, __ATOMIC_SEQ_CST);
+            __atomic_and_fetch (&promotee->b_flags, ~ETS_BLFL_ROH, __ATOMIC_SEQ_CST);
 
-            block_cache->b_owning_lkg = lkg;
+            __atomic_store_n (&promotee->b_owning_tid, ets_tid (), __ATOMIC_SEQ_CST);
+            __atomic_store_n (&promotee->b_owning_lkg, lkg, __ATOMIC_SEQ_CST);
 
-            __atomic_store_n (&lkg->l_active, block_cache->b_next, __ATOMIC_SEQ_CST);
+            __atomic_store_n (&lkg->l_active, promotee, __ATOMIC_SEQ_CST);
 
-            ets_mutex_unlock (&block_cache->b_next->b_access);
+            ets_mutex_unlock (&promotee->b_access);
             ets_mutex_unlock (&block_cache->b_access);
             ets_mutex_unlock (&lkg->l_access);
 
 #if ETS_CHECK_PROMOTION_FAILURES
-            r = ets_block_alloc_object (block_cache->b_next, object);
+            r = ets_block_alloc_object (promotee, object);
             if (r != E_OK) return E_LKG_SPOILED_PROMOTEE;
             return E_OK;
 #else
-            r = ets_block_alloc_object (block_cache->b_next, object);
+            r = ets_block_alloc_object (promotee, object);
             CTXDOWN ("ets_block_alloc_object returned %i; object=%p", r, *object)
             return r;
 #endif
@@ -1490,13 +3129,15 @@ static int ets_lkg_alloc_object (ets_lkg_t *lkg, ets_heap_t *heap, void **object
     ets_block_t *tmp;
     r = ets_lkg_req_block_from_heap (heap, lkg->l_index, &tmp);
     if (ETS_ISERR (r)) {
+        ets_mutex_unlock (&block_cache->b_access);
+        ets_mutex_unlock (&lkg->l_access);
         CTXDOWN ("ets_lkg_req_block_from_heap failed with error code %i", r)
         return r;
     }
     LOG ("pulled block %p", tmp)
 
     __atomic_or_fetch (&tmp->b_flags, ETS_BLFL_HEAD | ETS_BLFL_IN_THEATRE, __ATOMIC_SEQ_CST);
-    __atomic_and_fetch (&tmp->b_flags, ETS_BLFL_ROH, __ATOMIC_SEQ_CST);
+    __atomic_and_fetch (&tmp->b_flags, ~ETS_BLFL_ROH, __ATOMIC_SEQ_CST);
     __atomic_store_n (&tmp->b_owning_tid, ets_tid (), __ATOMIC_SEQ_CST);
     __atomic_store_n (&tmp->b_owning_lkg, lkg, __ATOMIC_SEQ_CST);
 
@@ -1505,7 +3146,9 @@ static int ets_lkg_alloc_object (ets_lkg_t *lkg, ets_heap_t *heap, void **object
     tmp->b_next = block_cache->b_next;
     if (tmp->b_next != nullptr)
         tmp->b_next->b_prev = tmp;
+    block_cache->b_next = tmp;
     __atomic_store_n (&lkg->l_active, tmp, __ATOMIC_SEQ_CST);
+    ++lkg->l_nblocks;
     ets_mutex_unlock (&tmp->b_access);
 
     ets_mutex_unlock (&block_cache->b_access);
@@ -1522,55 +3165,125 @@ static int ets_lkg_alloc_object (ets_lkg_t *lkg, ets_heap_t *heap, void **object
 #endif
 }
 
+static int ets_lkg_reserve (ets_lkg_t *lkg, ets_heap_t *heap, size_t count, int flags)
+{
+    CTXUP ("ets_lkg_reserve called with lkg=%p, heap=%p, count=%zu, flags=%i",
+           lkg, heap, count, flags)
+
+    /* what the linkage already has free right of head counts. Slides never
+     * look left of head, and the head ends up there: whatever is freed back
+     * to it stays out of reach while its longer-lived objects keep it from
+     * being righted */
+    size_t nfree = 0;
+    ets_mutex_lock (&lkg->l_access);
+    ets_block_t *const head_cache = __atomic_load_n (&lkg->l_active, __ATOMIC_SEQ_CST);
+    ets_block_t *block;
+    for (block = head_cache; block != nullptr; block = block->b_next) {
+        if (block != head_cache) {
+            nfree += block->b_ocnt - __atomic_load_n (&block->b_acnt, __ATOMIC_SEQ_CST);
+        }
+        if (flags & ETS_RESERVE_PREFAULT) {
+            ets_pages_prefault (block, block->b_nblocks * ETS_BLOCK_SIZE);
+        }
+    }
+    ets_mutex_unlock (&lkg->l_access);
 
-/* SECTION: API */
+    int r = E_OK;
+    while (nfree < count) {
+        r = ets_lkg_req_block_from_heap (heap, lkg->l_index, &block);
+        if (E_OK != r) {
+            LOG ("ets_lkg_req_block_from_heap failed with error code %i", r)
+            break;
+        }
+        /* the block goes straight to the right of head, where an empty
+         * free list means a full block */
+        ets_block_carve_all (block);
+        if (flags & ETS_RESERVE_PREFAULT) {
+            ets_pages_prefault (block, block->b_nblocks * ETS_BLOCK_SIZE);
+        }
+        nfree += block->b_ocnt - __atomic_load_n (&block->b_acnt, __ATOMIC_SEQ_CST);
 
-#include <etesian/liballoc/thread_support.h>
-#define ETS_HEAP_SIZE (24 + 20 * sizeof (ets_lkg_t))
+        ets_mutex_lock (&lkg->l_access);
+        __atomic_store_n (&block->b_owning_tid, ets_tid (), __ATOMIC_SEQ_CST);
+        __atomic_store_n (&block->b_owning_lkg, lkg, __ATOMIC_SEQ_CST);
+        ets_block_t *const active_cache = __atomic_load_n (&lkg->l_active, __ATOMIC_SEQ_CST);
+        if (active_cache == nullptr) {
+            __atomic_or_fetch (&block->b_flags, ETS_BLFL_HEAD | ETS_BLFL_IN_THEATRE, __ATOMIC_SEQ_CST);
+            __atomic_and_fetch (&block->b_flags, ~ETS_BLFL_ROH, __ATOMIC_SEQ_CST);
+            block->b_next = nullptr;
+            block->b_prev = nullptr;
+            __atomic_store_n (&lkg->l_active, block, __ATOMIC_SEQ_CST);
+        } else {
+            __atomic_and_fetch (&block->b_flags, ~ETS_BLFL_HEAD, __ATOMIC_SEQ_CST);
+            __atomic_or_fetch (&block->b_flags, ETS_BLFL_ROH | ETS_BLFL_IN_THEATRE, __ATOMIC_SEQ_CST);
+            __atomic_clear (&block->b_flisroh, __ATOMIC_SEQ_CST);
+            block->b_prev = active_cache;
+            block->b_next = active_cache->b_next;
+            if (block->b_next)
+                block->b_next->b_prev = block;
+            active_cache->b_next = block;
+        }
+        ++lkg->l_nblocks;
+        ets_mutex_unlock (&block->b_access);
+        ets_mutex_unlock (&lkg->l_access);
+    }
 
-static thread_local uint8_t _ETS_heap_backing[ETS_HEAP_SIZE];
-static auto _ETS_heap_destructor_lambda = scoped_lambda<void (ets_heap_t *&)> (
-    [] (ets_heap_t *&heap) -> void {
-        ets_heap_evacuate_and_clean (heap);
-    });
-namespace ets::alloc::heap_detail {
-    thread_local ets::alloc::thread_support::LocalWrapper<ets_heap_t *, false>
-        _ETS_local_heap (scoped_lambda<ets_heap_t *()> ([] () -> ets_heap_t * {
-                             ets_heap_t *heap = (ets_heap_t *)_ETS_heap_backing;
-                             heap->h_owning_heap = nullptr;
-                             heap->h_nlkgs = 20;
-                             for (size_t i = 0; i < heap->h_nlkgs; ++i) {
-                                 ets_lkg_init (&heap->h_lkgs[i], i, heap);
-                             }
-                             return heap;
-                         }),
-                         _ETS_heap_destructor_lambda);
+    ets_mutex_lock (&lkg->l_access);
+    lkg->l_nreserved = (flags & ETS_RESERVE_PIN) ? lkg->l_nblocks : 0;
+    ets_mutex_unlock (&lkg->l_access);
+
+    CTXDOWN ("reserved %zu free objects over %zu blocks", nfree, lkg->l_nblocks)
+    return r;
 }
 
+
+/* SECTION: API */
+
+#include <etesian/liballoc/alloc.h>
+#include <etesian/liballoc/thread_support.h>
+
+//! A pool slot: pool pages hold as many as fit after their first cache line,
+//! which links to the previous page. Free slots are zeroed but for their
+//! first word, which links to the next free slot.
+struct _ETS_opaque_heap
+{
+    alignas (ETS_CACHE_LINE_SIZE) uint8_t _0[ETS_HEAP_SIZE];
+};
+#define ETS_RHEAP_BLOCK_SIZE 0x4000L
+#define ETS_RHEAP_BLOCK_NSLOTS ((ETS_RHEAP_BLOCK_SIZE - ETS_CACHE_LINE_SIZE) / sizeof (_ETS_opaque_heap))
 static void *_ETS_last_rheap_block{ nullptr };
 static ets::alloc::thread_support::PThreadMutex _ETS_rheaps_access;
 static void *_ETS_rheaps_freelist{ nullptr };
+namespace ets::alloc::heap_detail {
+    constinit thread_local ets_heap_t *_ETS_heap_cache = nullptr;
+}
+//! Heaps left behind by exited threads, waiting to be adopted.
+//! Guarded by _ETS_rheaps_access.
+static struct _ETS_page_vect _ETS_abandoned_heaps = _ETS_PAGE_VECT_INIT (sizeof (ets_heap_t *));
 
 namespace ets::alloc::heap_detail {
     int create_regional_heap (void **rheapp)
     {
-        struct _OpaqueHeap
-        {
-            uint8_t _0[ETS_HEAP_SIZE];
-        };
         _ETS_rheaps_access.lock ();
         if (!_ETS_rheaps_freelist) {
             void *new_rheap_block;
-            ets_pages_alloc (&new_rheap_block, 0x4000);
+            const int r = ets_pages_alloc (&new_rheap_block, ETS_RHEAP_BLOCK_SIZE);
+            if (E_OK != r) {
+                _ETS_rheaps_access.unlock ();
+                (*rheapp) = nullptr;
+                return r;
+            }
             *(void **)new_rheap_block = _ETS_last_rheap_block;
-            _OpaqueHeap *ophps = (_OpaqueHeap *)((void **)new_rheap_block + 1);
-            const size_t cnt = (0x4000 / sizeof (_OpaqueHeap)) - 1;
+            /* the first cache line holds the link to the previous page */
+            _ETS_opaque_heap *ophps = (_ETS_opaque_heap *)((uint8_t *)new_rheap_block + ETS_CACHE_LINE_SIZE);
+            const size_t cnt = ETS_RHEAP_BLOCK_NSLOTS;
             size_t i;
             for (i = 0; i < cnt - 1; ++i) {
                 *((void **)&ophps[i]) = ophps + i + 1;
             }
             *((void **)&ophps[i]) = nullptr;
             _ETS_last_rheap_block = new_rheap_block;
+            _ETS_rheaps_freelist = ophps;
         }
 
         (*rheapp) = _ETS_rheaps_freelist;
@@ -1579,11 +3292,217 @@ namespace ets::alloc::heap_detail {
 
         return E_OK;
     }
+}
+
+//! Thread heaps are drawn from the same pool as regional heaps rather than
+//! living in thread-local storage, since the blocks they hand out outlive the
+//! thread and keep pointing at its linkages. An exiting thread abandons its
+//! heap as-is; the next thread to start adopts it, blocks and all. This relies
+//! on thread ids never being recycled (ETS_TID_TRY_RECYCLE): remote frees to
+//! the abandoned blocks keep going through `b_gfl` until the adopter takes
+//! them over.
+//! Thread-safe: 1
+static ets_heap_t *ets_heap_adopt ()
+{
+    ets_heap_t *heap = nullptr;
+    _ETS_rheaps_access.lock ();
+    _ets_page_vect_pop (&_ETS_abandoned_heaps, &heap);
+    _ETS_rheaps_access.unlock ();
+    if (heap) {
+        __atomic_and_fetch (&heap->h_flags, ~ETS_HPFL_ABANDONED, __ATOMIC_SEQ_CST);
+        CTX ("adopted abandoned heap %p", heap)
+        ets::alloc::heap_detail::_ETS_heap_cache = heap;
+        return heap;
+    }
+
+    if (E_OK != ets::alloc::heap_detail::create_regional_heap ((void **)&heap)) {
+        fprintf (stderr, "cannot allocate thread heap\n");
+        abort ();
+    }
+    heap->h_owned_heaps = 0;
+    heap->h_owning_heap = nullptr;
+    heap->h_nlkgs = ETS_HEAP_NLKGS;
+    for (size_t i = 0; i < heap->h_nlkgs; ++i) {
+        ets_lkg_init (&heap->h_lkgs[i], i, heap);
+    }
+    /* the background thread only looks at the heap once this is set */
+    __atomic_store_n (&heap->h_flags, ETS_HPFL_THREAD, __ATOMIC_RELEASE);
+    ets::alloc::heap_detail::_ETS_heap_cache = heap;
+    return heap;
+}
+
+//! Thread-safe: 1
+static void ets_heap_abandon (ets_heap_t *heap)
+{
+    ets::alloc::heap_detail::_ETS_heap_cache = nullptr;
+    /* reservations were the exiting thread's; the adopter makes its own */
+    for (size_t lkgi = 1; lkgi < heap->h_nlkgs; ++lkgi) {
+        ets_mutex_lock (&heap->h_lkgs[lkgi].l_access);
+        heap->h_lkgs[lkgi].l_nreserved = 0;
+        ets_mutex_unlock (&heap->h_lkgs[lkgi].l_access);
+    }
+    __atomic_or_fetch (&heap->h_flags, ETS_HPFL_ABANDONED, __ATOMIC_SEQ_CST);
+    /* the blocks still carry our id, and the adopter takes them over one
+     * slide at a time; frees from later destructors must not write a private
+     * free list the adopter may already be allocating from */
+    __ETS_tid = ets_tid_next_monotonic ();
+    _ETS_rheaps_access.lock ();
+    _ets_page_vect_push (&_ETS_abandoned_heaps, &heap);
+    _ETS_rheaps_access.unlock ();
+    CTX ("abandoned heap %p", heap)
+}
+
+static auto _ETS_heap_destructor_lambda = scoped_lambda<void (ets_heap_t *&)> (
+    [] (ets_heap_t *&heap) -> void {
+        /* frees from later destructors go straight to their blocks */
+        ets::alloc::heap_detail::_ETS_tcache.tc_state = ETS_TCACHE_RETIRED;
+        ets_tcache_flush (&ets::alloc::heap_detail::_ETS_tcache);
+        ets_rfb_flush (&_ETS_rfb);
+        _ETS_rfb.rfb_state = ETS_RFB_RETIRED;
+        ets_heap_abandon (heap);
+    });
+namespace ets::alloc::heap_detail {
+    thread_local ets::alloc::thread_support::LocalWrapper<ets_heap_t *, false>
+        _ETS_local_heap (scoped_lambda<ets_heap_t *()> ([] () -> ets_heap_t * {
+                             return ets_heap_adopt ();
+                         }),
+                         _ETS_heap_destructor_lambda);
+}
+
+static void ets_heap_ensure_local ()
+{
+    (void)*ets::alloc::heap_detail::_ETS_local_heap;
+}
+
+/* SECTION: BACKGROUND */
+
+static bool ets_bgmm_defer_lift (ets_block_t *block)
+{
+    if (ETS_BGMM_RUNNING != __atomic_load_n (&__ets_bgmm.bg_state, __ATOMIC_SEQ_CST)
+        || __atomic_load_n (&__ets_bgmm.bg_nlifted, __ATOMIC_RELAXED) >= ETS_BGMM_LIFT_QUEUE_MAX) {
+        return false;
+    }
+    ets_block_t *head = __atomic_load_n (&__ets_bgmm.bg_lifted, __ATOMIC_RELAXED);
+    do {
+        block->b_next = head;
+    } while (!__atomic_compare_exchange_n (&__ets_bgmm.bg_lifted, &head, block, true,
+                                           __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    if (ETS_BGMM_LIFT_QUEUE_MAX / 2 == __atomic_add_fetch (&__ets_bgmm.bg_nlifted, 1, __ATOMIC_RELAXED)) {
+        ets_bgmm_wake ();
+    }
+    /* a stop may have raced the push, and with it the thread's last drain */
+    if (ETS_BGMM_RUNNING != __atomic_load_n (&__ets_bgmm.bg_state, __ATOMIC_SEQ_CST)) {
+        ets_bgmm_drain ();
+    }
+    return true;
+}
+
+static void ets_bgmm_wake ()
+{
+    __atomic_add_fetch (&__ets_bgmm.bg_wake, 1, __ATOMIC_SEQ_CST);
+    ets_wake_all (&__ets_bgmm.bg_wake);
+}
+
+static int ets_bgmm_drain ()
+{
+    ets_block_t *block = __atomic_exchange_n (&__ets_bgmm.bg_lifted, nullptr, __ATOMIC_ACQUIRE);
+    int r = E_OK;
+    size_t n = 0;
+    for (ets_block_t *iter = block; iter; iter = iter->b_next) {
+        ++n;
+    }
+    __atomic_sub_fetch (&__ets_bgmm.bg_nlifted, n, __ATOMIC_RELAXED);
+    while (block) {
+        /* catching overwrites b_next */
+        ets_block_t *const next = block->b_next;
+        ets_lkg_t *const lkg = __atomic_load_n (&block->b_owning_lkg, __ATOMIC_SEQ_CST);
+        const int cr = ets_heap_catch (ets_get_heap_for_lkg (lkg), block, lkg->l_index);
+        if (E_OK != cr) r = cr;
+        block = next;
+    }
+    return r;
+}
+
+//! The periodic half of the background thread's work.
+//! Thread-safe: 1
+static void ets_bgmm_tick (uint64_t now)
+{
+    CTXUP ("ets_bgmm_tick called with now=%lu", now)
+    ets_bgmm_purge (now, ETS_BGMM_PURGE_DECAY_MS * 1000000ul);
+
+    /* the frontier's demand, smoothed, sets how many chunks to keep ready */
+    const uint64_t ncarved = __atomic_load_n (&__ets_span_frontier.sf_ncarved, __ATOMIC_RELAXED);
+    __ets_bgmm.bg_carve_rate = (3 * __ets_bgmm.bg_carve_rate + ((ncarved - __ets_bgmm.bg_ncarved) << ETS_BGMM_RATE_SHIFT)) / 4;
+    __ets_bgmm.bg_ncarved = ncarved;
+    const size_t target = ((__ets_bgmm.bg_carve_rate * ETS_PROVISION_LEAD_TICKS) + (63ul << ETS_BGMM_RATE_SHIFT) - 1)
+                          / (63ul << ETS_BGMM_RATE_SHIFT);
+    __atomic_store_n (&__ets_span_frontier.sf_target, target < ETS_PROVISION_MAX_CHUNKS ? target : ETS_PROVISION_MAX_CHUNKS,
+                      __ATOMIC_RELAXED);
+
+    const uint64_t decay_ns = __atomic_load_n (&__ets_chunk_cache_decay_ns, __ATOMIC_RELAXED);
+    const size_t max_nchunks = __atomic_load_n (&__ets_chunk_cache_max_nchunks, __ATOMIC_RELAXED);
+    ets_chunk_cache_trim (&__ets_chunk_cache, now, decay_ns, max_nchunks);
+
+    /* pool slots are never unmapped while the process runs, and the lock
+     * keeps regional heaps from being freed under the walk */
+    _ETS_rheaps_access.lock ();
+    for (void *iter = _ETS_last_rheap_block; iter; iter = *(void **)iter) {
+        _ETS_opaque_heap *ophps = (_ETS_opaque_heap *)((uint8_t *)iter + ETS_CACHE_LINE_SIZE);
+        for (size_t i = 0; i < ETS_RHEAP_BLOCK_NSLOTS; ++i) {
+            ets_heap_t *const heap = (ets_heap_t *)&ophps[i];
+            const uint32_t flags = __atomic_load_n (&heap->h_flags, __ATOMIC_ACQUIRE);
+            if ((ETS_HPFL_ABANDONED & flags) || !(ETS_HPFL_THREAD & flags)) continue;
+            ets_heap_trim_ulkg (heap, ETS_BGMM_ULKG_KEEP);
+            /* an idle heap is left to run low */
+            const uint64_t nreqs = __atomic_load_n (&heap->h_nreqs, __ATOMIC_RELAXED);
+            if (nreqs == heap->h_nreqs_seen) continue;
+            heap->h_nreqs_seen = nreqs;
+            const size_t nblocks = __atomic_load_n (&heap->h_lkgs[0].l_nblocks, __ATOMIC_RELAXED);
+            if (nblocks < ETS_BGMM_ULKG_LOW) {
+                ets_heap_refill_ulkg (heap, ETS_BGMM_ULKG_REFILL - nblocks);
+            }
+        }
+    }
+    _ETS_rheaps_access.unlock ();
+    CTXDOWN ("tick done")
+}
+
+static void *ets_bgmm_main (void *)
+{
+    uint64_t next_tick = 0;
+    while (ETS_BGMM_RUNNING == __atomic_load_n (&__ets_bgmm.bg_state, __ATOMIC_SEQ_CST)) {
+        /* read before the drain, so that a wakeup after it cuts the wait
+         * short */
+        const uint32_t wake = __atomic_load_n (&__ets_bgmm.bg_wake, __ATOMIC_SEQ_CST);
+        ets_bgmm_drain ();
+        uint64_t now = ets_now_ns ();
+        if (__atomic_exchange_n (&__ets_bgmm.bg_purge_now, false, __ATOMIC_SEQ_CST)) {
+            ets_bgmm_purge (now, 0);
+        }
+        if (now >= next_tick) {
+            ets_bgmm_tick (now);
+            now = ets_now_ns ();
+            next_tick = now + __atomic_load_n (&__ets_bgmm.bg_interval_ns, __ATOMIC_RELAXED);
+        }
+        /* one chunk per round, so that lifts and purges are not held up */
+        if (!ets_span_frontier_provision ()) {
+            ets_wait_on (&__ets_bgmm.bg_wake, wake, next_tick - now);
+        }
+    }
+    ets_bgmm_drain ();
+    ets_bgmm_purge (ets_now_ns (), 0);
+    /* chunks already ready stay there for the frontier to take */
+    __atomic_store_n (&__ets_span_frontier.sf_target, 0, __ATOMIC_RELAXED);
+    return nullptr;
+}
+
+namespace ets::alloc::heap_detail {
 
     int free_regional_heap (void *rheap)
     {
-        memset (rheap, 0, ETS_HEAP_SIZE);
+        /* under the pool's lock, which the background thread walks it with */
         _ETS_rheaps_access.lock ();
+        memset (rheap, 0, ETS_HEAP_SIZE);
         *(void **)rheap = _ETS_rheaps_freelist;
         _ETS_rheaps_freelist = rheap;
         _ETS_rheaps_access.unlock ();
@@ -1596,7 +3515,7 @@ namespace ets::alloc::heap_detail {
         void *iter = _ETS_last_rheap_block;
         while (iter) {
             void *next_iter = *(void **)iter;
-            ets_pages_free (iter, 0x4000);
+            ets_pages_free (iter, ETS_RHEAP_BLOCK_SIZE);
             iter = next_iter;
         }
         _ETS_rheaps_access.unlock ();
@@ -1614,11 +3533,338 @@ namespace ets::alloc::heap_detail {
     {
         if (!object)
             return E_FAIL;
+        const uintptr_t entry = ets_pmap_lookup_object (&__ets_page_map, object);
+        if (UNLIKELY (ETS_PMAP_CHUNK != ets_pmap_kind (entry))) {
+            if (ETS_PMAP_LARGE == ets_pmap_kind (entry)) {
+                return ets_large_dealloc_object ((ets_large_t *)ets_pmap_chunk (entry));
+            }
+            /* not ours: leave it be */
+            return E_FOREIGN;
+        }
         ets_block_t *block = ets_get_block_for_object (object);
-        return ets_block_dealloc_object (block, object);
+        object = ets_block_object_start (block, object);
+#if ETS_FEATURE_TCACHE
+        const size_t lkgi = ets_lup_sli (block->b_osize);
+        if (lkgi < ETS_TCACHE_NBINS && ets_tcache_push (&_ETS_tcache, lkgi, object)) {
+            return E_OK;
+        }
+#endif
+        return ets_block_release_object (block, object);
+    }
+    int alloc_batch (size_t osize, size_t n, void **objects)
+    {
+        ets_heap_t *const heap = *_ETS_local_heap;
+        const size_t lkgi = ets_lup_sli (osize);
+        size_t i = 0;
+        int r = E_OK;
+        if (lkgi >= heap->h_nlkgs) {
+            for (; i < n; ++i) {
+                r = ets_large_alloc_object (&objects[i], osize, 0);
+                if (E_OK != r) goto fail;
+            }
+            return E_OK;
+        }
+#if ETS_FEATURE_TCACHE
+        if (lkgi < ETS_TCACHE_NBINS) {
+            ets_tcache_bin_t *const bin = &_ETS_tcache.tc_bins[lkgi];
+            for (; i < n && bin->tb_head; ++i) {
+                objects[i] = bin->tb_head;
+                bin->tb_head = *(void **)objects[i];
+                --bin->tb_count;
+            }
+        }
+#endif
+        {
+            /* one object through the linkage, which leaves a head block with
+             * something on its free lists, then as much of the rest as that
+             * block can give in one go */
+            ets_lkg_t *const lkg = &heap->h_lkgs[lkgi];
+            while (i < n) {
+                r = ets_lkg_alloc_object (lkg, heap, &objects[i]);
+                if (E_OK != r) goto fail;
+                ++i;
+                void *object, *last;
+                size_t got = ets_block_alloc_chain (__atomic_load_n (&lkg->l_active, __ATOMIC_SEQ_CST),
+                                                    n - i, &object, &last);
+                for (; got; --got) {
+                    objects[i++] = object;
+                    object = *(void **)object;
+                }
+            }
+        }
+        return E_OK;
+    fail:
+        free_batch (objects, i);
+        return r;
+    }
+    int free_batch (void **objects, size_t n)
+    {
+        /* one chain and one b_acnt adjustment per block, rather than per run
+         * of its objects */
+        ets_rfb_group_t groups[ETS_FREE_BATCH_NGROUPS] = {};
+        size_t taken[ETS_FREE_BATCH_NGROUPS / 2];
+        size_t ntaken = 0;
+        for (size_t i = 0; i < n; ++i) {
+            void *const object = objects[i];
+            if (!object) continue;
+            const uintptr_t entry = ets_pmap_lookup_object (&__ets_page_map, object);
+            if (UNLIKELY (ETS_PMAP_CHUNK != ets_pmap_kind (entry))) {
+                if (ETS_PMAP_LARGE == ets_pmap_kind (entry)) {
+                    ets_large_dealloc_object ((ets_large_t *)ets_pmap_chunk (entry));
+                }
+                continue;
+            }
+            ets_block_t *const block = ets_get_block_for_object (object);
+            size_t gi = ((uintptr_t)block / ETS_BLOCK_SIZE) % ETS_FREE_BATCH_NGROUPS;
+            while (groups[gi].rg_block && groups[gi].rg_block != block) {
+                gi = (gi + 1) % ETS_FREE_BATCH_NGROUPS;
+            }
+            if (!groups[gi].rg_block) {
+                if (ntaken == ETS_FREE_BATCH_NGROUPS / 2) {
+                    for (size_t ti = 0; ti < ntaken; ++ti) {
+                        ets_rfb_flush_group (&groups[taken[ti]]);
+                    }
+                    ntaken = 0;
+                    gi = ((uintptr_t)block / ETS_BLOCK_SIZE) % ETS_FREE_BATCH_NGROUPS;
+                }
+                taken[ntaken++] = gi;
+            }
+            ets_rfb_group_add (&groups[gi], block, ets_block_object_start (block, object));
+        }
+        for (size_t ti = 0; ti < ntaken; ++ti) {
+            ets_rfb_flush_group (&groups[taken[ti]]);
+        }
+        return E_OK;
+    }
+    int dealloc_sized_object (void *object, size_t osize)
+    {
+        if (!object)
+            return E_FAIL;
+        const size_t lkgi = ets_lup_sli (osize);
+#if ETS_DEBUG_SIZED_DEALLOC
+        const uintptr_t entry = ets_pmap_lookup_object (&__ets_page_map, object);
+        const bool is_large = ETS_PMAP_LARGE == ets_pmap_kind (entry);
+        if (ETS_PMAP_NONE == ets_pmap_kind (entry)) {
+            fprintf (stderr, "sized deallocation of %p, which is not ours\n", object);
+            abort ();
+        }
+        if (is_large ? lkgi < ETS_HEAP_NLKGS
+                     : lkgi != ets_lup_sli (ets_get_block_for_object (object)->b_osize)) {
+            fprintf (stderr, "sized deallocation of %p with size %zu, which is not its size class\n",
+                     object, osize);
+            abort ();
+        }
+#endif
+#if ETS_FEATURE_TCACHE
+        if (lkgi < ETS_TCACHE_NBINS && ets_tcache_push (&_ETS_tcache, lkgi, object)) {
+            return E_OK;
+        }
+#endif
+        return dealloc_object (object);
+    }
+    int flush_remote_frees ()
+    {
+        return ets_rfb_flush (&_ETS_rfb);
+    }
+    int flush_tcache ()
+    {
+        ets_tcache_flush (&_ETS_tcache);
+        return E_OK;
+    }
+    int reserve (size_t osize, size_t count, int flags)
+    {
+        ets_heap_t *const heap = *_ETS_local_heap;
+        const size_t lkgi = ets_lup_sli (osize);
+        if (lkgi >= heap->h_nlkgs) {
+            /* large objects are mapped one at a time, on demand */
+            return E_FAIL;
+        }
+#if ETS_FEATURE_TCACHE
+        /* refills leave up to a bin's worth in the object cache, where they
+         * count as allocated */
+        if (count && lkgi < ETS_TCACHE_NBINS) {
+            count += ets_tcache_bin_capacity (lkgi);
+        }
+#endif
+        return ets_lkg_reserve (&heap->h_lkgs[lkgi], heap, count, flags);
+    }
+    int configure_chunk_cache (uint64_t decay_ms, size_t max_bytes)
+    {
+        __atomic_store_n (&__ets_chunk_cache_decay_ns, decay_ms * 1000000ul, __ATOMIC_RELAXED);
+        __atomic_store_n (&__ets_chunk_cache_max_nchunks, max_bytes / ETS_CHUNK_SIZE, __ATOMIC_RELAXED);
+        return decay_chunk_cache ();
+    }
+    int start_background_thread (uint64_t interval_ms)
+    {
+        ets_mutex_lock (&__ets_bgmm.bg_access);
+        if (ETS_BGMM_STOPPED != __ets_bgmm.bg_state) {
+            ets_mutex_unlock (&__ets_bgmm.bg_access);
+            return E_FAIL;
+        }
+        __atomic_store_n (&__ets_bgmm.bg_interval_ns,
+                          (interval_ms ? interval_ms : ETS_BGMM_INTERVAL_MS) * 1000000ul, __ATOMIC_RELAXED);
+        __ets_bgmm.bg_ncarved = __atomic_load_n (&__ets_span_frontier.sf_ncarved, __ATOMIC_RELAXED);
+        __ets_bgmm.bg_carve_rate = 0;
+        __atomic_store_n (&__ets_bgmm.bg_state, ETS_BGMM_RUNNING, __ATOMIC_SEQ_CST);
+        if (0 != pthread_create (&__ets_bgmm.bg_thread, nullptr, ets_bgmm_main, nullptr)) {
+            __atomic_store_n (&__ets_bgmm.bg_state, ETS_BGMM_STOPPED, __ATOMIC_SEQ_CST);
+            ets_mutex_unlock (&__ets_bgmm.bg_access);
+            return E_FAIL;
+        }
+        ets_mutex_unlock (&__ets_bgmm.bg_access);
+        return E_OK;
+    }
+    int stop_background_thread ()
+    {
+        ets_mutex_lock (&__ets_bgmm.bg_access);
+        if (ETS_BGMM_RUNNING != __ets_bgmm.bg_state) {
+            ets_mutex_unlock (&__ets_bgmm.bg_access);
+            return E_FAIL;
+        }
+        __atomic_store_n (&__ets_bgmm.bg_state, ETS_BGMM_STOPPING, __ATOMIC_SEQ_CST);
+        ets_bgmm_wake ();
+        pthread_join (__ets_bgmm.bg_thread, nullptr);
+        /* lifts that saw the thread running but were pushed after its last
+         * drain */
+        ets_bgmm_drain ();
+        /* nothing provisions or decays chunks any more */
+        ets_span_frontier_unprovision ();
+        __atomic_store_n (&__ets_bgmm.bg_state, ETS_BGMM_STOPPED, __ATOMIC_SEQ_CST);
+        ets_mutex_unlock (&__ets_bgmm.bg_access);
+        return E_OK;
+    }
+    int decay_chunk_cache ()
+    {
+        return ets_chunk_cache_trim (&__ets_chunk_cache, ets_now_ns (),
+                                     __atomic_load_n (&__ets_chunk_cache_decay_ns, __ATOMIC_RELAXED),
+                                     __atomic_load_n (&__ets_chunk_cache_max_nchunks, __ATOMIC_RELAXED));
     }
     int alloc_object (void **objectp, size_t osize)
     {
         return ::ets_heap_alloc_object (*_ETS_local_heap, objectp, osize);
     }
+    void *alloc_slow (size_t osize)
+    {
+        void *object;
+#if ETS_FEATURE_TCACHE
+        const size_t lkgi = ets_lup_sli (osize);
+        if (lkgi < ETS_TCACHE_NBINS) {
+            if (E_OK != ets_tcache_refill (&_ETS_tcache, *_ETS_local_heap, lkgi, &object)) {
+                return nullptr;
+            }
+            return object;
+        }
+#endif
+        if (E_OK != ::ets_heap_alloc_object (*_ETS_local_heap, &object, osize)) {
+            return nullptr;
+        }
+        return object;
+    }
+    int realloc_object (void **objectp, size_t osize)
+    {
+        void *object = *objectp;
+        if (!object) {
+            return alloc_object (objectp, osize);
+        }
+        if (!osize) {
+            (*objectp) = nullptr;
+            return dealloc_object (object);
+        }
+        const uintptr_t entry = ets_pmap_lookup_object (&__ets_page_map, object);
+        if (UNLIKELY (ETS_PMAP_NONE == ets_pmap_kind (entry))) {
+            return E_FOREIGN;
+        }
+        if (ETS_PMAP_LARGE == ets_pmap_kind (entry)) {
+            ets_large_t *large = (ets_large_t *)ets_pmap_chunk (entry);
+            /* staying large: let the kernel do the work */
+            if (ets_lup_sli (osize) >= (*_ETS_local_heap)->h_nlkgs) {
+                return ets_large_realloc_object (large, objectp, osize);
+            }
+            void *fresh;
+            const int r = alloc_object (&fresh, osize);
+            if (E_OK != r) return r;
+            memcpy (fresh, object, large->lg_osize < osize ? large->lg_osize : osize);
+            ets_large_dealloc_object (large);
+            (*objectp) = fresh;
+            return E_OK;
+        }
+        ets_block_t *block = ets_get_block_for_object (object);
+        void *const start = ets_block_object_start (block, object);
+        /* what is left of the object past an aligned address */
+        const size_t old_osize = block->b_osize - ((uint8_t *)object - (uint8_t *)start);
+        if (start == object && osize <= old_osize && ets_lup_sli (osize) == ets_lup_sli (old_osize)) {
+            return E_OK;
+        }
+        void *fresh;
+        const int r = alloc_object (&fresh, osize);
+        if (E_OK != r) return r;
+        memcpy (fresh, object, old_osize < osize ? old_osize : osize);
+        ets_block_dealloc_object (block, start);
+        (*objectp) = fresh;
+        return E_OK;
+    }
+    int alloc_zeroed_object (void **objectp, size_t osize)
+    {
+        const int r = alloc_object (objectp, osize);
+        if (E_OK != r) return r;
+        /* large regions come straight from the kernel, and are already zeroed */
+        if (!(ETS_CHFL_LARGE & ets_get_chunk_for_object (*objectp)->c_flags)) {
+            memset (*objectp, 0, osize);
+        }
+        return E_OK;
+    }
+    int alloc_aligned_object (void **objectp, size_t align, size_t osize)
+    {
+        if (align & (align - 1)) {
+            (*objectp) = nullptr;
+            return E_FAIL;
+        }
+        ets_heap_t *heap = *_ETS_local_heap;
+        if (align <= ETS_CACHE_LINE_SIZE) {
+            /* objects in blocks start a whole number of cache lines into a
+             * block (header, bitmaps and colour), so the first size class
+             * that is a multiple of the alignment will do */
+            for (size_t lkgi = ets_lup_sli (osize); lkgi < heap->h_nlkgs; ++lkgi) {
+                const size_t class_osize = ets_rlup_sli (lkgi);
+                if (!(class_osize & (align - 1))) {
+                    return ::ets_heap_alloc_object (heap, objectp, class_osize);
+                }
+            }
+        } else if (align <= ETS_BLOCK_SIZE && osize <= SIZE_MAX - align) {
+            /* a line-aligned object `align - ETS_CACHE_LINE_SIZE` bytes
+             * larger has an aligned address with `osize` bytes past it; frees
+             * find their way back to the object's start */
+            for (size_t lkgi = ets_lup_sli (osize + align - ETS_CACHE_LINE_SIZE); lkgi < heap->h_nlkgs; ++lkgi) {
+                const size_t class_osize = ets_rlup_sli (lkgi);
+                if (!(class_osize & (ETS_CACHE_LINE_SIZE - 1))) {
+                    void *object;
+                    const int r = ::ets_heap_alloc_object (heap, &object, class_osize);
+                    if (E_OK != r) {
+                        (*objectp) = nullptr;
+                        return r;
+                    }
+                    (*objectp) = (void *)(((uintptr_t)object + align - 1) & ~(uintptr_t)(align - 1));
+                    return E_OK;
+                }
+            }
+        }
+        return ets_large_alloc_object (objectp, osize, align);
+    }
+    size_t usable_size (void *object)
+    {
+        const uintptr_t entry = ets_pmap_lookup_object (&__ets_page_map, object);
+        if (ETS_PMAP_LARGE == ets_pmap_kind (entry)) {
+            ets_large_t *large = (ets_large_t *)ets_pmap_chunk (entry);
+            return large->lg_msize - large->lg_offset;
+        }
+        if (ETS_PMAP_CHUNK == ets_pmap_kind (entry)) {
+            ets_block_t *const block = ets_get_block_for_object (object);
+            return block->b_osize - ((uint8_t *)object - (uint8_t *)ets_block_object_start (block, object));
+        }
+        return 0;
+    }
+    bool owns (const void *object)
+    {
+        return ETS_PMAP_NONE != ets_pmap_kind (ets_pmap_lookup_object (&__ets_page_map, object));
+    }
 }
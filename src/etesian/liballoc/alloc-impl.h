@@ -7,53 +7,120 @@
 #include <stddef.h>
 #include <pthread.h>
 
+#include <etesian/liballoc/lock.h>
+
 struct ets_lkg;
 
 #define PRECONDITION(s)
 
 #define ETS_BLOCK_SIZE 0x4000L
+#define ETS_CACHE_LINE_SIZE 64L
 
 //! Block of memory in a chunk.
+//! Medium size classes are served from spans: runs of `b_nblocks` contiguous
+//! blocks sharing the header of the first.
+//! The header spans three cache lines, by who writes them: the first holds
+//! what is set when the block is formatted or changes hands and otherwise
+//! only read, by the owner and remote frees alike (the free path's owner
+//! check, the size class); the second what only the owner writes on every
+//! allocation, along with the list links and flags, written under the
+//! linkage lock; the third what remote frees write on every free: the
+//! remote free list and `b_acnt`, which every free and flush adjusts, so
+//! that the owner's allocation line is never invalidated by them. The owner
+//! still counts its allocations in `b_acnt`, on the remote line. Remote
+//! frees only reach the second line when a block changes state (righting
+//! or emptying it, under the linkage lock).
 typedef struct ets_block
 {
-    void *b_pfl, *b_gfl;
-
-    uint8_t b_flags;
-    uint8_t b_flisroh;
+    uint64_t b_owning_tid;
+    struct ets_lkg *b_owning_lkg;
+    uint32_t b_osize;
+    //! Reciprocal of `b_osize`, as a 32-bit fixed-point fraction (rounded
+    //! up), so that the index of the object an address falls in is a
+    //! multiply and a shift.
+    uint32_t b_osize_recip;
     uint16_t b_ocnt;
-    uint16_t b_acnt;
-    uint16_t b_osize;
+    uint16_t b_nblocks;
+    //! Offset of the first object into `b_memory`: past the bitmaps, if any,
+    //! and then the block's colour, a whole number of cache lines taken out
+    //! of the slack at the end of the block so that the objects of different
+    //! blocks do not all start on the same cache sets.
+    uint16_t b_objoff;
+    //! Bitmap blocks only: words per bitmap, and (with `b_bmhint`) the
+    //! lowest word of the private bitmap that may have a bit set.
+    uint8_t b_bmwords;
 
+    void *b_pfl __attribute__ ((aligned (ETS_CACHE_LINE_SIZE)));
+    //! Objects [0, b_ncarved) have been handed out at least once; the rest
+    //! have never been touched, and are carved off in order once the free
+    //! lists run dry.
+    uint16_t b_ncarved;
+    uint8_t b_flags;
+    uint8_t b_bmhint;
     struct ets_block *b_prev, *b_next;
-    struct ets_lkg *b_owning_lkg;
-    uint64_t b_owning_tid;
 
-    pthread_mutex_t b_access;
+    void *b_gfl __attribute__ ((aligned (ETS_CACHE_LINE_SIZE)));
+    uint16_t b_acnt;
+    uint8_t b_flisroh;
+    ets_lock_t b_access;
 } ets_block_t;
+static_assert (offsetof (ets_block_t, b_pfl) == ETS_CACHE_LINE_SIZE,
+               "read-mostly block fields must fit in one cache line");
+static_assert (offsetof (ets_block_t, b_gfl) == 2 * ETS_CACHE_LINE_SIZE,
+               "owner-side block fields must fit in one cache line");
+
+//! Blocks of classes up to ETS_BITMAP_MAX_OSIZE bytes keep track of their
+//! free objects in bitmaps rather than free lists: a private one (the
+//! counterpart of `b_pfl`) and a remote one (of `b_gfl`), on their own cache
+//! lines at the start of the block's memory, with a set bit for every free
+//! object. Allocation finds a set bit with a count of trailing zeroes, and
+//! never touches object memory; a remote free is an atomic OR.
+#ifndef ETS_FEATURE_BITMAP_BLOCKS
+    #define ETS_FEATURE_BITMAP_BLOCKS 1
+#endif
+#define ETS_BITMAP_MAX_OSIZE 64
+
+//! Block header size, rounded so that object memory starts on a cache line.
+//! Any object whose size class is a multiple of some alignment no greater than
+//! ETS_CACHE_LINE_SIZE is therefore aligned to it.
+#define ETS_BLOCK_HEADER_SIZE ((sizeof (ets_block_t) + ETS_CACHE_LINE_SIZE - 1) & ~(ETS_CACHE_LINE_SIZE - 1))
 
 typedef struct ets_opaque_block
 {
-    void *b_pfl, *b_gfl;
+    ets_block_t b_header;
+    uint8_t b_memory[ETS_BLOCK_SIZE - ETS_BLOCK_HEADER_SIZE] __attribute__ ((aligned (ETS_CACHE_LINE_SIZE)));
+} ets_opaque_block_t;
 
-    uint8_t b_flags;
-    uint8_t b_flisroh;
-    uint16_t b_ocnt;
-    uint16_t b_acnt;
-    uint16_t b_osize;
+//! Remote frees are buffered per thread, in ETS_RFB_NGROUPS groups mapped
+//! directly from the destination block's address. A group goes out as one
+//! pre-linked chain, with a single `b_acnt` adjustment, once it holds
+//! ETS_RFB_FLUSH_THRESHOLD objects (or a quarter of the block), when its slot
+//! is wanted for another block, or when the thread flushes or exits.
+#define ETS_RFB_NGROUPS 16
+#define ETS_RFB_FLUSH_THRESHOLD 32
 
-    struct ets_block *b_prev, *b_next;
-    struct ets_lkg *b_owning_lkg;
-    uint64_t b_owning_tid;
+typedef struct ets_rfb_group
+{
+    ets_block_t *rg_block;
+    void *rg_first, *rg_last;
+    size_t rg_count;
+} ets_rfb_group_t;
 
-    pthread_mutex_t b_gaccess;
-    uint8_t b_memory[ETS_BLOCK_SIZE - sizeof (ets_block_t)];
-} ets_opaque_block_t;
-//! Get the block that owns the object at the specified memory location.
-//! Thread-safe:1
-inline ets_block_t *ets_get_block_for_object (void *object)
+//! `free_batch` gathers a batch's objects by block in a table of
+//! ETS_FREE_BATCH_NGROUPS groups, open-addressed from the block's address,
+//! so that each block gets one chain however its objects are interleaved.
+//! Once half the groups are taken, what they hold goes out and the table
+//! starts over.
+#define ETS_FREE_BATCH_NGROUPS 256
+
+#define ETS_RFB_UNARMED 0
+#define ETS_RFB_ARMED 1
+#define ETS_RFB_RETIRED 2
+typedef struct ets_rfb
 {
-    return (ets_block_t *)(void *)((uintptr_t)object & ~(ETS_BLOCK_SIZE - 1));
-}
+    ets_rfb_group_t rfb_groups[ETS_RFB_NGROUPS];
+    int rfb_state;
+} ets_rfb_t;
 
 struct ets_heap;
 
@@ -68,56 +135,532 @@ struct ets_heap;
 //!         -or- when blocks from a downstream heap are evacuating
 //!  5. blocks will only ever be added to the left of the head when the head
 //!         becomes full -or- when blocks from a downstream heap are evacuating
+//! Each linkage has a cache line to itself, so that neighbouring size classes
+//! in `h_lkgs` never false-share. `l_nreserved` is how many blocks a
+//! reservation pinned: the linkage lifts none while it holds no more.
 typedef struct ets_lkg
 {
     struct ets_heap *l_owning_heap;
     ets_block_t *l_active;
     size_t l_index;
     size_t l_nblocks;
-    pthread_mutex_t l_access;
-} ets_lkg_t;
+    size_t l_nreserved;
+    ets_lock_t l_access;
+} __attribute__ ((aligned (ETS_CACHE_LINE_SIZE))) ets_lkg_t;
+
+//! Flags to `reserve`: fault every page of the reserved blocks in for
+//! writing, and keep the linkage from handing them back as they empty.
+#define ETS_RESERVE_PREFAULT 0x01
+#define ETS_RESERVE_PIN 0x02
+
+//! Size classes come in pairs per power of two, 2^n + 2^(n-1) and 2^(n+1),
+//! starting from 16 bytes at linkage 1 and ending at 256 KiB.
+//! Thread-safe: 1
+constexpr size_t ets_sli_geometric_osize (size_t gi)
+{
+    --gi;
+    return (16ul << (gi >> 1)) + ((gi & 1) << ((gi >> 1) + 3));
+}
+//! Index of the geometric class for an object of `osize` bytes. The bit below
+//! the leading one of `osize - 1` picks between the two classes of its power
+//! of two; clamping to 15 (a cmov) folds everything up to 16 bytes,
+//! `osize == 0` included, into class 1 without a branch.
+//! Thread-safe: 1
+constexpr size_t ets_sli_geometric_lup (size_t osize)
+{
+    const size_t m = osize < 16 ? 15 : osize - 1;
+    const size_t n = 63 - __builtin_clzl (m);
+    return 2 * n - 6 + ((m >> (n - 1)) & 1);
+}
+#define ETS_SLI_GEOMETRIC_NLKGS 30
+#define ETS_SLI_GEOMETRIC_LKGI_MEDIUM 17
+
+//! ETS_HEAP_NLKGS is the number of linkages in a heap; linkage 0 is unsized,
+//! and linkages [ETS_LKGI_MEDIUM, ETS_HEAP_NLKGS) are served from multi-block
+//! spans. The medium tier starts at 4 KiB rather than at 2 KiB: a single
+//! block of 2 KiB or 3 KiB objects wastes no more than the eighth a span is
+//! allowed to (see ets_span_nblocks), so spans would leave those classes
+//! one block long anyway, while keeping them small keeps them in the object
+//! cache and lets them take blocks from the unsized linkage. 4 KiB is the
+//! first class a lone block wastes more of.
+#ifndef ETS_FEATURE_TUNED_SIZE_CLASSES
+    #define ETS_FEATURE_TUNED_SIZE_CLASSES 0
+#endif
+#if ETS_FEATURE_TUNED_SIZE_CLASSES
+    //! Generated by rtsizeclass: a class table for [1, ETS_SLI_TUNED_LIMIT]
+    //! fitted to a recorded size histogram. Classes past the limit keep to
+    //! the geometric schedule, shifted by however many classes the tuned
+    //! range gained or lost.
+    #include <etesian/liballoc/sli-tuned.h>
+static constexpr uint32_t ets_sli_tuned_osize[] = { ETS_SLI_TUNED_OSIZES };
+    #define ETS_SLI_TUNED_NCLASSES (sizeof (ets_sli_tuned_osize) / sizeof (ets_sli_tuned_osize[0]))
+    #define ETS_SLI_TUNED_SHIFT (ETS_SLI_TUNED_NCLASSES - ets_sli_geometric_lup (ETS_SLI_TUNED_LIMIT))
+    #define ETS_HEAP_NLKGS (ETS_SLI_GEOMETRIC_NLKGS + ETS_SLI_TUNED_SHIFT)
+    #define ETS_LKGI_MEDIUM (ETS_SLI_GEOMETRIC_LKGI_MEDIUM + ETS_SLI_TUNED_SHIFT)
+static_assert (ETS_SLI_TUNED_LIMIT <= 2048 && !(ETS_SLI_TUNED_LIMIT & (ETS_SLI_TUNED_LIMIT - 1)),
+               "tuned classes must end on a geometric class below the medium tier");
+static_assert (ets_sli_tuned_osize[ETS_SLI_TUNED_NCLASSES - 1] == ETS_SLI_TUNED_LIMIT,
+               "tuned classes must end at ETS_SLI_TUNED_LIMIT");
+static_assert (ETS_SLI_TUNED_GRANULE >= 8 && !(ETS_SLI_TUNED_GRANULE & (ETS_SLI_TUNED_GRANULE - 1)),
+               "tuned classes must leave room for, and align, a free list link");
+
+//! For every multiple of ETS_SLI_TUNED_GRANULE up to the limit, the linkage
+//! index of the smallest tuned class holding it.
+typedef struct ets_sli_tuned_lup_table
+{
+    uint8_t stl_lkgi[ETS_SLI_TUNED_LIMIT / ETS_SLI_TUNED_GRANULE + 1];
+} ets_sli_tuned_lup_table_t;
+constexpr ets_sli_tuned_lup_table_t ets_make_sli_tuned_lup_table ()
+{
+    ets_sli_tuned_lup_table_t table{};
+    size_t ti = 0;
+    for (size_t i = 0; i <= ETS_SLI_TUNED_LIMIT / ETS_SLI_TUNED_GRANULE; ++i) {
+        while (ets_sli_tuned_osize[ti] < i * ETS_SLI_TUNED_GRANULE) ++ti;
+        table.stl_lkgi[i] = ti + 1;
+    }
+    return table;
+}
+inline constexpr ets_sli_tuned_lup_table_t ets_sli_tuned_lup_table = ets_make_sli_tuned_lup_table ();
+#else
+    #define ETS_HEAP_NLKGS ETS_SLI_GEOMETRIC_NLKGS
+    #define ETS_LKGI_MEDIUM ETS_SLI_GEOMETRIC_LKGI_MEDIUM
+#endif
+//! Longest span, in blocks.
+#define ETS_SPAN_MAX_NBLOCKS 32
+
+typedef struct ets_sli_table
+{
+    uint32_t st_osize[ETS_HEAP_NLKGS];
+} ets_sli_table_t;
+constexpr ets_sli_table_t ets_make_sli_table ()
+{
+    ets_sli_table_t table{};
+    for (size_t lkgi = 1; lkgi < ETS_HEAP_NLKGS; ++lkgi) {
+#if ETS_FEATURE_TUNED_SIZE_CLASSES
+        table.st_osize[lkgi] = lkgi <= ETS_SLI_TUNED_NCLASSES
+                                   ? ets_sli_tuned_osize[lkgi - 1]
+                                   : ets_sli_geometric_osize (lkgi - ETS_SLI_TUNED_SHIFT);
+#else
+        table.st_osize[lkgi] = ets_sli_geometric_osize (lkgi);
+#endif
+    }
+    return table;
+}
+//! Object size of each linkage; 0 for the unsized linkage.
+inline constexpr ets_sli_table_t ets_sli_table = ets_make_sli_table ();
+
+//! Object size of linkage `lkgi`, which must be in [1, ETS_HEAP_NLKGS).
+//! Thread-safe: 1
+constexpr size_t ets_rlup_sli (size_t lkgi)
+{
+    return ets_sli_table.st_osize[lkgi];
+}
+//! Linkage index for an object of `osize` bytes; ETS_HEAP_NLKGS or more if
+//! no class is large enough. `osize == 0` gets the smallest class, as does
+//! `osize == 1`, so that zero-sized requests never fall through to a mapping
+//! of their own.
+//! Thread-safe: 1
+constexpr size_t ets_lup_sli (size_t osize)
+{
+#if ETS_FEATURE_TUNED_SIZE_CLASSES
+    if (osize <= ETS_SLI_TUNED_LIMIT) {
+        return ets_sli_tuned_lup_table.stl_lkgi[(osize + ETS_SLI_TUNED_GRANULE - 1) / ETS_SLI_TUNED_GRANULE];
+    }
+    return ets_sli_geometric_lup (osize) + ETS_SLI_TUNED_SHIFT;
+#else
+    return ets_sli_geometric_lup (osize);
+#endif
+}
+
+constexpr bool ets_sli_table_is_consistent ()
+{
+    for (size_t lkgi = 1; lkgi < ETS_HEAP_NLKGS; ++lkgi) {
+        const size_t osize = ets_rlup_sli (lkgi);
+        if (osize % 8 || osize <= ets_rlup_sli (lkgi - 1)) {
+            return false;
+        }
+        if (ets_lup_sli (osize) != lkgi || ets_lup_sli (osize + 1) != lkgi + 1) {
+            return false;
+        }
+    }
+    /* the last small class fits a lone block as well as a span would */
+    const size_t small_usable = ETS_BLOCK_SIZE - ETS_BLOCK_HEADER_SIZE;
+    return 1 == ets_lup_sli (1) && 1 == ets_lup_sli (0)
+           && ets_rlup_sli (ETS_LKGI_MEDIUM - 1) < ETS_BLOCK_SIZE / 4
+           && ets_rlup_sli (ETS_LKGI_MEDIUM) >= ETS_BLOCK_SIZE / 4
+           && 8 * (small_usable % ets_rlup_sli (ETS_LKGI_MEDIUM - 1) + ETS_BLOCK_HEADER_SIZE) <= ETS_BLOCK_SIZE;
+}
+static_assert (ets_sli_table_is_consistent (), "ets_lup_sli and ets_sli_table disagree");
+
+//! Per-thread object cache: for each small linkage, a stack of objects that
+//! the thread has taken out of its blocks (they still count in `b_acnt`), so
+//! that an alloc/free pair is a pop and a push with no atomics. Bins refill
+//! from, and drain to, their blocks half a bin at a time.
+#ifndef ETS_FEATURE_TCACHE
+    #define ETS_FEATURE_TCACHE 1
+#endif
+#define ETS_TCACHE_NBINS ETS_LKGI_MEDIUM
+//! Check the size given to a sized deallocation against the block header,
+//! which the sized fast path otherwise never reads.
+#ifndef ETS_DEBUG_SIZED_DEALLOC
+    #define ETS_DEBUG_SIZED_DEALLOC 0
+#endif
+//! Bytes a bin may hold, whatever its size class, between 8 and 64 objects.
+#define ETS_TCACHE_BIN_BYTES 0x4000L
+
+typedef struct ets_tcache_bin
+{
+    void *tb_head;
+    size_t tb_count;
+} ets_tcache_bin_t;
+
+#define ETS_TCACHE_UNARMED 0
+#define ETS_TCACHE_ARMED 1
+#define ETS_TCACHE_RETIRED 2
+typedef struct ets_tcache
+{
+    ets_tcache_bin_t tc_bins[ETS_TCACHE_NBINS];
+    int tc_state;
+} ets_tcache_t;
+
+typedef struct ets_tcache_capacity_table
+{
+    uint8_t tct_capacity[ETS_TCACHE_NBINS];
+} ets_tcache_capacity_table_t;
+constexpr ets_tcache_capacity_table_t ets_make_tcache_capacity_table ()
+{
+    ets_tcache_capacity_table_t table{};
+    for (size_t lkgi = 1; lkgi < ETS_TCACHE_NBINS; ++lkgi) {
+        const size_t n = ETS_TCACHE_BIN_BYTES / ets_rlup_sli (lkgi);
+        table.tct_capacity[lkgi] = n < 8 ? 8 : (n > 64 ? 64 : n);
+    }
+    return table;
+}
+inline constexpr ets_tcache_capacity_table_t ets_tcache_capacity_table = ets_make_tcache_capacity_table ();
+
+//! Most objects bin `lkgi` holds before it is drained.
+//! Thread-safe: 1
+constexpr size_t ets_tcache_bin_capacity (size_t lkgi)
+{
+    return ets_tcache_capacity_table.tct_capacity[lkgi];
+}
+
+struct ets_chunk;
+
+//! Chunks none of whose blocks are active any longer, kept mapped and
+//! resident rather than released at once, so that the next burst finds them
+//! without a fault; newest first, and reused from the front. A chunk goes
+//! back to the arena (or the kernel) once it has sat for the decay period,
+//! or, oldest first, once the cache holds more than its cap.
+#define ETS_CHUNK_CACHE_DECAY_MS 10000
+#define ETS_CHUNK_CACHE_MAX_BYTES (64 * ETS_CHUNK_SIZE)
+typedef struct ets_chunk_cache
+{
+    struct ets_chunk *cc_first, *cc_last;
+    size_t cc_nchunks;
+    ets_lock_t cc_access;
+} ets_chunk_cache_t;
 
 //! Either local or regional; global is hardcoded as a NULL value in
-//! `h_owning_heap`.
-//! 0TE: IF ADDING OR SUBTRACTING MEMBERS, REMEMBER TO MODIFY ets_get_heap_for_lkg
+//! `h_owning_heap`. `h_lkgs` starts on its own cache line.
 typedef struct ets_heap
 {
     size_t h_owned_heaps;
     struct ets_heap *h_owning_heap;
     size_t h_nlkgs;
+    uint32_t h_flags;
+    //! Blocks the heap's linkages have asked it for, and that count as of
+    //! the background thread's last look; a heap that asked for none since
+    //! is idle, and its unsized linkage is not topped up.
+    uint64_t h_nreqs;
+    uint64_t h_nreqs_seen;
     ets_lkg_t h_lkgs[];
 } ets_heap_t;
 
+//! Set in `h_flags` once a thread heap is ready for use, and while it waits
+//! to be adopted after its thread has exited.
+#define ETS_HPFL_THREAD 0x01
+#define ETS_HPFL_ABANDONED 0x02
+
 struct ets_arena;
 
 static inline ets_heap_t *ets_get_heap_for_lkg (ets_lkg_t *lkg)
 {
-    return (ets_heap_t *)((uint8_t *)(lkg - lkg->l_index) - sizeof (ets_heap_t *) - sizeof (size_t) - sizeof (size_t));
+    return (ets_heap_t *)((uint8_t *)(lkg - lkg->l_index) - offsetof (ets_heap_t, h_lkgs));
 }
-
-struct ets_chunk_tracker;
+//! Bytes taken by a heap with a full set of linkages.
+#define ETS_HEAP_SIZE (offsetof (ets_heap_t, h_lkgs) + ETS_HEAP_NLKGS * sizeof (ets_lkg_t))
 
 #define ETS_CHUNK_SIZE 0x100000L
 //! Large memory chunk
 typedef struct ets_chunk
 {
-    struct ets_chunk *c_next, *c_prev;
-    struct ets_chunk_tracker *c_tracker;
     int64_t c_flags;
     size_t c_nactive;
     uint64_t c_active_mask;
+    //! Blocks whose memory has been handed back to the kernel (with huge
+    //! pages, left for their chunk to hand back) but which stay mapped, to be
+    //! reused before the frontier moves on; same numbering as
+    //! `c_active_mask`. Chunks with any are on the purged list.
+    uint64_t c_purged_mask;
+    struct ets_chunk *c_purged_next, *c_purged_prev;
+    //! Purged blocks whose memory is in fact still there, left for the
+    //! background thread to purge once they have sat free for the decay
+    //! period; a subset of `c_purged_mask`. `c_dirty_at` (monotonic
+    //! nanoseconds) is when the latest of them was left, so that none is
+    //! purged early; the others may wait longer.
+    uint64_t c_dirty_mask;
+    uint64_t c_dirty_at;
+    //! Place in a chunk cache, and when the chunk went in, in monotonic
+    //! nanoseconds.
+    struct ets_chunk *c_cache_next, *c_cache_prev;
+    uint64_t c_retired_at;
+    //! For each block in the chunk, the distance (in blocks) back to the head
+    //! of the span containing it; 0 for single blocks and span heads.
+    uint8_t c_span_head[ETS_CHUNK_SIZE / ETS_BLOCK_SIZE];
 } ets_chunk_t;
-typedef struct ets_chunk_tracker
+
+//! Two-level radix map from chunk number (an address shifted down by
+//! ETS_PMAP_SHIFT) to what the allocator keeps there: the header governing
+//! the chunk, tagged with its kind in the low bits, which chunk alignment
+//! leaves free. A large region has an entry for every chunk it spans, all
+//! pointing at its one header. Leaves are mapped on first use and never
+//! freed, so a lookup is two loads and takes no lock; entries are set when a
+//! chunk is bound or a large region mapped, and cleared when they go.
+#define ETS_PMAP_SHIFT __builtin_ctzl (ETS_CHUNK_SIZE)
+//! Addresses past ETS_PMAP_ADDRESS_BITS bits are never ours.
+#define ETS_PMAP_ADDRESS_BITS 48
+#define ETS_PMAP_KEY_BITS (ETS_PMAP_ADDRESS_BITS - ETS_PMAP_SHIFT)
+#define ETS_PMAP_LEAF_BITS 14
+#define ETS_PMAP_ROOT_BITS (ETS_PMAP_KEY_BITS - ETS_PMAP_LEAF_BITS)
+#define ETS_PMAP_NONE 0x00L
+#define ETS_PMAP_CHUNK 0x01L
+#define ETS_PMAP_LARGE 0x02L
+#define ETS_PMAP_KIND_MASK 0x03L
+typedef struct ets_page_map
+{
+    uintptr_t *pm_leaves[1L << ETS_PMAP_ROOT_BITS];
+} ets_page_map_t;
+
+//! Entry for the chunk at `memory`: 0 (ETS_PMAP_NONE) if it is not ours.
+//! Thread-safe: 1
+inline uintptr_t ets_pmap_lookup (ets_page_map_t *pm, const void *memory)
+{
+    const uintptr_t key = (uintptr_t)memory >> ETS_PMAP_SHIFT;
+    if (key >> ETS_PMAP_KEY_BITS) return ETS_PMAP_NONE;
+    uintptr_t *const leaf = __atomic_load_n (&pm->pm_leaves[key >> ETS_PMAP_LEAF_BITS], __ATOMIC_ACQUIRE);
+    if (!leaf) return ETS_PMAP_NONE;
+    return __atomic_load_n (&leaf[key & ((1L << ETS_PMAP_LEAF_BITS) - 1)], __ATOMIC_ACQUIRE);
+}
+inline uintptr_t ets_pmap_kind (uintptr_t entry)
+{
+    return entry & ETS_PMAP_KIND_MASK;
+}
+inline ets_chunk_t *ets_pmap_chunk (uintptr_t entry)
 {
-    ets_chunk_t *ct_first;
-    pthread_mutex_t ct_access;
-} ets_chunk_tracker_t;
+    return (ets_chunk_t *)(entry & ~ETS_PMAP_KIND_MASK);
+}
+//! Chunks with purged blocks, most recently purged first.
+typedef struct ets_purged_list
+{
+    ets_chunk_t *pl_first;
+    //! Blocks in every chunk's `c_dirty_mask`.
+    size_t pl_ndirty;
+    ets_lock_t pl_access;
+} ets_purged_list_t;
+//! Chunk from which fresh blocks and spans are carved, front to back; the
+//! headers of blocks from `sf_next` on have never been written, so a chunk
+//! costs nothing per block until its blocks are used. Once a span no longer
+//! fits, the leftover blocks are handed to an unsized linkage.
+//!
+//! With the background thread running, the next chunks are provisioned
+//! ahead of demand: allocated, bound and prefaulted off the critical path,
+//! and queued on `sf_ready` (linked through `c_cache_next`), so that moving
+//! the frontier on is a pop. The thread keeps `sf_target` chunks ready, from
+//! the blocks carved per interval, smoothed over the last few, enough for
+//! ETS_PROVISION_LEAD_TICKS intervals, and at most ETS_PROVISION_MAX_CHUNKS.
+#define ETS_PROVISION_LEAD_TICKS 2
+#define ETS_PROVISION_MAX_CHUNKS 8
+typedef struct ets_span_frontier
+{
+    ets_chunk_t *sf_chunk;
+    size_t sf_next;
+    ets_chunk_t *sf_ready;
+    size_t sf_nready;
+    size_t sf_target;
+    //! Blocks carved since the start; read by the background thread.
+    uint64_t sf_ncarved;
+    ets_lock_t sf_access;
+} ets_span_frontier_t;
+
+//! Chunks are carved out of address space reserved ETS_ARENA_STEP bytes at a
+//! time with PROT_NONE, and committed ETS_ARENA_COMMIT_STEP bytes at a time as
+//! the bump index reaches them. Freed chunks are purged but stay committed,
+//! and are reused before the bump moves on; nothing is ever unmapped, so
+//! every chunk lies in one of the arena's regions for good.
+#define ETS_ARENA_STEP 0x40000000L
+#define ETS_ARENA_STEP_NCHUNKS (ETS_ARENA_STEP / ETS_CHUNK_SIZE)
+#define ETS_ARENA_COMMIT_STEP (16 * ETS_CHUNK_SIZE)
+#define ETS_ARENA_MAX_REGIONS 64
+
+//! Huge page backing for arena chunks, two chunks to a huge page. With
+//! ETS_CHUNK_HUGE_PAGES_THP, regions are ETS_HUGE_PAGE_SIZE-aligned and
+//! advised MADV_HUGEPAGE as they are committed; with
+//! ETS_CHUNK_HUGE_PAGES_HUGETLB, regions are reserved the same way, but
+//! committed a huge page at a time from the hugetlb pool, by mapping
+//! MAP_HUGETLB pages over them, so that only what is in use is set aside in
+//! the pool; from the first page the pool cannot cover on, THP takes over.
+//! Either way, memory only goes back to the kernel a whole huge page at
+//! a time: blocks are no longer purged on their own, and a freed chunk is
+//! purged together with its buddy once both are free.
+#define ETS_CHUNK_HUGE_PAGES_NONE 0
+#define ETS_CHUNK_HUGE_PAGES_THP 1
+#define ETS_CHUNK_HUGE_PAGES_HUGETLB 2
+#ifndef ETS_FEATURE_CHUNK_HUGE_PAGES
+    #define ETS_FEATURE_CHUNK_HUGE_PAGES ETS_CHUNK_HUGE_PAGES_NONE
+#endif
+#define ETS_HUGE_PAGE_SIZE 0x200000L
+#define ETS_HUGE_PAGE_NCHUNKS (ETS_HUGE_PAGE_SIZE / ETS_CHUNK_SIZE)
+#if ETS_FEATURE_CHUNK_HUGE_PAGES
+    #define ETS_ARENA_ALIGN ETS_HUGE_PAGE_SIZE
+#else
+    #define ETS_ARENA_ALIGN ETS_CHUNK_SIZE
+#endif
+static_assert (!(ETS_ARENA_COMMIT_STEP % ETS_HUGE_PAGE_SIZE) && !(ETS_ARENA_STEP % ETS_HUGE_PAGE_SIZE),
+               "arena regions must commit whole huge pages");
+
+typedef struct ets_arena_region
+{
+    uint8_t *ar_base;
+    //! Chunks, from the base, committed from the hugetlb pool.
+    size_t ar_nhugetlb;
+    //! Chunks handed out from the bump, and chunks committed, from the base.
+    size_t ar_next, ar_committed;
+    //! Freed chunks, ready to be handed out again.
+    uint64_t ar_free[ETS_ARENA_STEP_NCHUNKS / 64];
+    size_t ar_nfree;
+} ets_arena_region_t;
+typedef struct ets_arena
+{
+    ets_arena_region_t a_regions[ETS_ARENA_MAX_REGIONS];
+    size_t a_nregions;
+    //! The hugetlb pool could not cover a page; THP from then on.
+    bool a_hugetlb_failed;
+    ets_lock_t a_access;
+} ets_arena_t;
+
+//! Background memory manager: an optional thread (see
+//! heap_detail::start_background_thread) that takes work off the free path.
+//! Blocks lifted out of their linkages are queued for it instead of being
+//! carried up through ets_heap_catch inline; besides, every `bg_interval_ns`,
+//! it purges blocks that have sat free for ETS_BGMM_PURGE_DECAY_MS, trims the
+//! chunk caches, and tops up the unsized linkages of thread heaps running
+//! low.
+#define ETS_BGMM_STOPPED 0
+#define ETS_BGMM_RUNNING 1
+#define ETS_BGMM_STOPPING 2
+#define ETS_BGMM_INTERVAL_MS 100
+#define ETS_BGMM_PURGE_DECAY_MS 1000
+//! Bytes of blocks left to purge past which the thread is woken to purge
+//! them all at once, without waiting out the decay; past twice that, frees
+//! purge inline again.
+#define ETS_BGMM_DIRTY_MAX_BYTES (1024 * ETS_BLOCK_SIZE)
+//! Chunks whose blocks are purged in one go, between takes of the purged
+//! list's lock.
+#define ETS_BGMM_PURGE_BATCH 32
+//! Lifted blocks the queue holds at most; past that, lifts are caught inline
+//! again, so that a thread starved of CPU cannot pin their chunks. The thread
+//! is woken once the queue is half full, and otherwise drains it every tick.
+#define ETS_BGMM_LIFT_QUEUE_MAX 64
+//! A thread heap's unsized linkage is topped up to ETS_BGMM_ULKG_REFILL
+//! blocks once it falls under ETS_BGMM_ULKG_LOW, if it took blocks since the
+//! last tick, and trimmed back to ETS_BGMM_ULKG_KEEP; a thread heap does not
+//! get the larger allowance of a root that feeds other heaps.
+#define ETS_BGMM_ULKG_LOW 4
+#define ETS_BGMM_ULKG_REFILL 8
+#define ETS_BGMM_ULKG_KEEP 16
+//! Fractional bits of the smoothed carve rate.
+#define ETS_BGMM_RATE_SHIFT 8
+typedef struct ets_bgmm
+{
+    //! Lifted blocks waiting for the thread, still locked and linked through
+    //! `b_next`; pushed lock-free and taken all at once.
+    ets_block_t *bg_lifted;
+    size_t bg_nlifted;
+    uint32_t bg_state;
+    //! Bumped to wake the thread, which sleeps on it.
+    uint32_t bg_wake;
+    //! Set to have the thread purge every dirty block on waking.
+    bool bg_purge_now;
+    uint64_t bg_interval_ns;
+    //! Frontier blocks carved as of the last tick, and per interval,
+    //! smoothed, in 1/2^ETS_BGMM_RATE_SHIFT of a block so that a trickle of
+    //! carving does not round down to none; see ets_span_frontier_t.
+    uint64_t bg_ncarved;
+    uint64_t bg_carve_rate;
+    pthread_t bg_thread;
+    ets_lock_t bg_access;
+} ets_bgmm_t;
 
 inline ets_chunk_t *ets_get_chunk_for_block (ets_block_t *block)
 {
     return (ets_chunk_t *)(void *)((uintptr_t)block & ~(ETS_CHUNK_SIZE - 1));
 }
+//! Get the chunk header governing the object at the specified location; for
+//! large objects, this is the header of the large region.
+//! Thread-safe:1
+inline ets_chunk_t *ets_get_chunk_for_object (void *object)
+{
+    return (ets_chunk_t *)(void *)((uintptr_t)object & ~(ETS_CHUNK_SIZE - 1));
+}
+
+//! Set in `c_flags` when the chunk header is actually the header of a large
+//! region.
+#define ETS_CHFL_LARGE 0x01L
+#define ETS_LARGE_HEADER_SIZE 0x1000L
+
+//! Large object region: objects that do not fit in any size class are mapped
+//! on their own ETS_CHUNK_SIZE-aligned swath. The header sits where a chunk
+//! header would, so `dealloc_object` can tell the two apart from `c_flags`
+//! alone; the object itself begins `lg_offset` bytes in: ETS_LARGE_HEADER_SIZE
+//! normally, or the requested alignment if that is larger, in which case the
+//! swath itself is aligned to it as well (and to no less than a chunk), so
+//! that the object is aligned however far in it starts.
+typedef struct ets_large
+{
+    ets_chunk_t lg_chunk;
+    size_t lg_osize;
+    size_t lg_msize;
+    size_t lg_offset;
+} ets_large_t;
+
+inline void *ets_get_large_object (ets_large_t *large)
+{
+    return (uint8_t *)large + large->lg_offset;
+}
+//! `ets_pmap_lookup` for an object rather than a chunk. A large region's
+//! entries cover the whole of its last chunk-sized slot, past which may lie
+//! someone else's mapping: an address there is not ours.
+//! Thread-safe: 1
+inline uintptr_t ets_pmap_lookup_object (ets_page_map_t *pm, const void *object)
+{
+    const uintptr_t entry = ets_pmap_lookup (pm, object);
+    if (ETS_PMAP_LARGE == ets_pmap_kind (entry)) {
+        ets_large_t *const large = (ets_large_t *)ets_pmap_chunk (entry);
+        if ((uintptr_t)object - (uintptr_t)large >= large->lg_msize) return ETS_PMAP_NONE;
+    }
+    return entry;
+}
 inline size_t ets_get_block_no (ets_block_t *block)
 {
-    return (((uintptr_t)block & ~(ETS_CHUNK_SIZE - 1)) / ETS_BLOCK_SIZE) - 1;
+    return (((uintptr_t)block & (ETS_CHUNK_SIZE - 1)) / ETS_BLOCK_SIZE) - 1;
+}
+//! Get the block (or the head of the span) that owns the object at the
+//! specified memory location.
+//! Thread-safe:1
+inline ets_block_t *ets_get_block_for_object (void *object)
+{
+    uint8_t *block = (uint8_t *)((uintptr_t)object & ~(ETS_BLOCK_SIZE - 1));
+    const ets_chunk_t *chunk = ets_get_chunk_for_block ((ets_block_t *)block);
+    return (ets_block_t *)(block - chunk->c_span_head[((uintptr_t)block & (ETS_CHUNK_SIZE - 1)) / ETS_BLOCK_SIZE] * ETS_BLOCK_SIZE);
 }
@@ -6,19 +6,191 @@
 #include <stdint.h>
 #include <stddef.h>
 
-#include <etesian/libcore/Maybe.h>
-#include <etesian/libcore/Result.h>
+#include <etesian/liballoc/alloc-impl.h>
 #include <etesian/liballoc/thread_support.h>
 
 namespace ets::alloc {
     namespace heap_detail {
         int alloc_object (void **objectp, size_t osize);
+        //! Like `alloc_object`, but the object is filled with zeroes.
+        int alloc_zeroed_object (void **objectp, size_t osize);
+        //! Like `alloc_object`, but the object is aligned to `align`, which must
+        //! be a power of two. Alignments up to the block size are served from
+        //! the size classes (past a cache line, from an address some way into
+        //! a larger object, which every other entry point accepts in its
+        //! place); larger ones get a region of their own.
+        int alloc_aligned_object (void **objectp, size_t align, size_t osize);
+        //! Objects that are not ours (see `owns`) are left alone.
         int dealloc_object (void *object);
+        //! Like `dealloc_object`, for an object allocated with `alloc (osize)`
+        //! or `alloc_object (..., osize)`. Small objects go straight into the
+        //! object cache without a look at their block.
+        int dealloc_sized_object (void *object, size_t osize);
+        int realloc_object (void **objectp, size_t osize);
+        //! Allocate `n` objects of `osize` bytes into `objects`, taking as
+        //! many as each head block can give at once. On failure, nothing
+        //! stays allocated.
+        int alloc_batch (size_t osize, size_t n, void **objects);
+        //! Deallocate `n` objects (null entries are skipped), handing each
+        //! block its objects as one chain rather than one by one.
+        int free_batch (void **objects, size_t n);
+        //! Hand over every free the calling thread has buffered for blocks it
+        //! does not own; call before going idle, so that they are not held
+        //! back until the thread next frees or exits.
+        int flush_remote_frees ();
+        //! Return every object in the calling thread's object cache to its
+        //! block.
+        int flush_tcache ();
+        //! Make sure the calling thread's linkage for `osize` has room for
+        //! `count` more objects without asking its heap for a block: what it
+        //! lacks is pulled in now, ready to allocate from. ETS_RESERVE_PREFAULT
+        //! also faults in every page of the linkage's blocks; ETS_RESERVE_PIN
+        //! keeps the linkage from handing any of them back as they empty,
+        //! until a reservation without it. E_FAIL for sizes past the largest
+        //! class, which are mapped per object.
+        int reserve (size_t osize, size_t count, int flags);
+        //! Set how long the chunk cache keeps a retired chunk before giving
+        //! it back, and how many bytes of chunks it may keep; 0 for either
+        //! releases chunks as soon as they retire.
+        int configure_chunk_cache (uint64_t decay_ms, size_t max_bytes);
+        //! Release whatever the chunk cache holds past its decay period or its
+        //! cap; chunks are otherwise only released as others retire, or by
+        //! the background thread.
+        int decay_chunk_cache ();
+        //! Start the background thread, which, every `interval_ms` (0 for the
+        //! default), purges blocks that have sat free a while, trims the
+        //! chunk caches and tops up thread heaps, and which catches blocks
+        //! lifted out of their linkages as they come. E_FAIL if it already
+        //! runs.
+        int start_background_thread (uint64_t interval_ms);
+        //! Stop the background thread and wait for it; whatever it had left
+        //! to purge is purged first. E_FAIL if it does not run.
+        int stop_background_thread ();
+        //! Number of bytes usable at `object`, which is at least the size it
+        //! was requested with.
+        size_t usable_size (void *object);
+        //! Whether `object` lies in memory this allocator handed out, in a
+        //! chunk or a large region; a page map lookup, with no lock.
+        bool owns (const void *object);
         int create_regional_heap (void **rheapp);
         int add_heap_to_regional_heap (void *rheap, void *heap);
         int free_regional_heap (void *rheap);
         int free_rheaps ();
 
-        extern thread_local thread_support::Local<void *> _ETS_local_heap;
+        //! Out-of-line half of `alloc`: everything past popping the object
+        //! cache or the private free list of the head block, including
+        //! refilling the cache. Returns nullptr on failure.
+        void *alloc_slow (size_t osize);
+
+        extern thread_local thread_support::LocalWrapper<::ets_heap *, false> _ETS_local_heap;
+        //! The calling thread's heap, or nullptr until its first allocation
+        //! (and again once the thread has abandoned it). Unlike
+        //! `_ETS_local_heap`, reading it never goes through a TLS init check.
+        extern constinit thread_local ::ets_heap *_ETS_heap_cache;
+        //! The calling thread's object cache; see ets_tcache_t.
+        extern constinit thread_local ::ets_tcache_t _ETS_tcache;
+    }
+
+    namespace heap_detail {
+        //! Inline half of `alloc`, for an already-resolved linkage index.
+        //! Thread-safe: 1
+        __attribute__ ((always_inline)) inline void *alloc_from_lkg (size_t lkgi, size_t osize)
+        {
+#if ETS_FEATURE_TCACHE
+            if (lkgi < ETS_TCACHE_NBINS) {
+                ::ets_tcache_bin_t *bin = &_ETS_tcache.tc_bins[lkgi];
+                void *object = bin->tb_head;
+                if (__builtin_expect (object != nullptr, 1)) {
+                    bin->tb_head = *(void **)object;
+                    --bin->tb_count;
+                    return object;
+                }
+                return alloc_slow (osize);
+            }
+#endif
+            ::ets_heap *heap = _ETS_heap_cache;
+            if (__builtin_expect (heap != nullptr && lkgi < ETS_HEAP_NLKGS, 1)) {
+                ets_block_t *block = __atomic_load_n (&heap->h_lkgs[lkgi].l_active, __ATOMIC_SEQ_CST);
+                if (__builtin_expect (block != nullptr, 1)) {
+                    void *object = block->b_pfl;
+                    if (__builtin_expect (object != nullptr, 1)) {
+                        block->b_pfl = *(void **)object;
+                        __atomic_add_fetch (&block->b_acnt, 1, __ATOMIC_SEQ_CST);
+                        return object;
+                    }
+                }
+            }
+            return alloc_slow (osize);
+        }
+    }
+
+    //! Allocate an object of `osize` bytes, returning nullptr on failure.
+    //! The common case, a non-empty bin in the thread's object cache for small
+    //! classes, or a non-empty private free list on the head block of the
+    //! thread's linkage for medium ones, is inlined at the call site; anything
+    //! else falls through to `heap_detail::alloc_slow`.
+    //! Thread-safe: 1
+    __attribute__ ((always_inline)) inline void *alloc (size_t osize)
+    {
+        return heap_detail::alloc_from_lkg (ets_lup_sli (osize), osize);
+    }
+
+    //! Deallocate an object allocated with `alloc (osize)`. Knowing the size
+    //! class, the common case is a push onto the thread's object cache that
+    //! never touches the block header.
+    //! Thread-safe: 1
+    __attribute__ ((always_inline)) inline void dealloc (void *object, size_t osize)
+    {
+#if ETS_FEATURE_TCACHE && !ETS_DEBUG_SIZED_DEALLOC
+        const size_t lkgi = ets_lup_sli (osize);
+        if (lkgi < ETS_TCACHE_NBINS) {
+            ::ets_tcache_t *tc = &heap_detail::_ETS_tcache;
+            ::ets_tcache_bin_t *bin = &tc->tc_bins[lkgi];
+            if (__builtin_expect (ETS_TCACHE_ARMED == tc->tc_state
+                                      && bin->tb_count < ets_tcache_bin_capacity (lkgi),
+                                  1)) {
+                *(void **)object = bin->tb_head;
+                bin->tb_head = object;
+                ++bin->tb_count;
+                return;
+            }
+        }
+#endif
+        heap_detail::dealloc_sized_object (object, osize);
+    }
+
+    //! `alloc` for a size known at compile time: the linkage index is folded
+    //! into the call site.
+    //! Thread-safe: 1
+    template <size_t N>
+    __attribute__ ((always_inline)) inline void *alloc ()
+    {
+        constexpr size_t lkgi = ets_lup_sli (N);
+        if constexpr (lkgi < ETS_HEAP_NLKGS) {
+            return heap_detail::alloc_from_lkg (lkgi, N);
+        } else {
+            return heap_detail::alloc_slow (N);
+        }
+    }
+
+    //! Uninitialized storage for a `T`. Objects are aligned to their size
+    //! class's largest power-of-two divisor (up to a cache line), so
+    //! over-aligned types that their class cannot honour take the aligned path.
+    //! Thread-safe: 1
+    template <typename T>
+    __attribute__ ((always_inline)) inline T *alloc_for ()
+    {
+        constexpr size_t lkgi = ets_lup_sli (sizeof (T));
+        if constexpr (lkgi < ETS_HEAP_NLKGS
+                      && alignof (T) <= ETS_CACHE_LINE_SIZE
+                      && !(ets_rlup_sli (lkgi) & (alignof (T) - 1))) {
+            return static_cast<T *> (alloc<sizeof (T)> ());
+        } else {
+            void *object;
+            if (heap_detail::alloc_aligned_object (&object, alignof (T), sizeof (T))) {
+                return nullptr;
+            }
+            return static_cast<T *> (object);
+        }
     }
 }
\ No newline at end of file
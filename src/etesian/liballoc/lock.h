@@ -0,0 +1,63 @@
+/* AUTHOR Maximilien M. Cura
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+//! Compact adaptive lock: `lk_state` is 0 when free, 1 when held, and 2 when
+//! held with threads (possibly) asleep on it. Acquiring spins for a while
+//! before sleeping on a futex, since most critical sections in the allocator
+//! are a handful of instructions; releasing only enters the kernel if someone
+//! may be asleep.
+typedef struct ets_lock
+{
+    uint32_t lk_state;
+} ets_lock_t;
+
+#define ETS_LOCK_INIT \
+    {                 \
+        .lk_state = 0 \
+    }
+//! Attempts at the lock before going to sleep on it.
+#define ETS_LOCK_SPIN 128
+
+//! Thread-safe: 1
+void ets_lock_acquire_slow (ets_lock_t *lock);
+//! Thread-safe: 1
+void ets_lock_release_slow (ets_lock_t *lock);
+//! Sleep while `*word` is `expected`, until woken with `ets_wake_all` or for
+//! at most `timeout_ns`; wakeups may be spurious.
+//! Thread-safe: 1
+void ets_wait_on (uint32_t *word, uint32_t expected, uint64_t timeout_ns);
+//! Thread-safe: 1
+void ets_wake_all (uint32_t *word);
+
+static inline void ets_lock_init (ets_lock_t *lock)
+{
+    __atomic_store_n (&lock->lk_state, 0, __ATOMIC_RELAXED);
+}
+
+//! Thread-safe: 1
+static inline bool ets_lock_try_acquire (ets_lock_t *lock)
+{
+    uint32_t expected = 0;
+    return __atomic_compare_exchange_n (&lock->lk_state, &expected, 1, false,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+//! Thread-safe: 1
+static inline void ets_lock_acquire (ets_lock_t *lock)
+{
+    if (__builtin_expect (!ets_lock_try_acquire (lock), 0)) {
+        ets_lock_acquire_slow (lock);
+    }
+}
+
+//! Thread-safe: 1
+static inline void ets_lock_release (ets_lock_t *lock)
+{
+    if (__builtin_expect (2 == __atomic_exchange_n (&lock->lk_state, 0, __ATOMIC_RELEASE), 0)) {
+        ets_lock_release_slow (lock);
+    }
+}
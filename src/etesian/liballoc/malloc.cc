@@ -0,0 +1,226 @@
+/* AUTHOR Maximilien M. Cura
+ */
+
+//! The C allocation ABI on top of heap_detail, for use as `libetesian` either
+//! linked in directly or interposed with LD_PRELOAD. Every entry point that
+//! glibc's allocator exports is replaced, so that no pointer from one
+//! allocator ever reaches the other; any that does anyway is recognized by the
+//! page map, and free and malloc_usable_size leave it alone.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#if __linux__
+    #include <malloc.h>
+#endif
+
+#include <etesian/liballoc/alloc.h>
+
+#ifndef __THROW
+    #define __THROW
+#endif
+
+#define ETS_EXPORT __attribute__ ((visibility ("default")))
+
+//! malloc must return memory suitably aligned for any fundamental type.
+#define ETS_MALLOC_ALIGN 16ul
+
+namespace heap_detail = ets::alloc::heap_detail;
+
+//! Round a request up to a multiple of ETS_MALLOC_ALIGN; every size class
+//! that is such a multiple hands out ETS_MALLOC_ALIGN-aligned objects.
+//! Returns 0 on overflow.
+static inline size_t ets_malloc_round (size_t size)
+{
+    if (!size) return ETS_MALLOC_ALIGN;
+    const size_t rounded = (size + ETS_MALLOC_ALIGN - 1) & ~(ETS_MALLOC_ALIGN - 1);
+    return rounded < size ? 0 : rounded;
+}
+
+static inline void *ets_malloc_aligned (size_t align, size_t size)
+{
+    const size_t osize = ets_malloc_round (size);
+    void *object;
+    if (!osize || heap_detail::alloc_aligned_object (&object, align, osize)) {
+        return nullptr;
+    }
+    return object;
+}
+
+extern "C" {
+ETS_EXPORT void *malloc (size_t size) __THROW
+{
+    /* 0 would be served from the smallest class */
+    const size_t osize = ets_malloc_round (size);
+    if (!osize) {
+        errno = ENOMEM;
+        return nullptr;
+    }
+    void *object = ets::alloc::alloc (osize);
+    if (!object) {
+        errno = ENOMEM;
+    }
+    return object;
+}
+
+ETS_EXPORT void free (void *object) __THROW
+{
+    if (object) {
+        heap_detail::dealloc_object (object);
+    }
+}
+
+ETS_EXPORT void *calloc (size_t nmemb, size_t size) __THROW
+{
+    size_t total;
+    if (__builtin_mul_overflow (nmemb, size, &total)) {
+        errno = ENOMEM;
+        return nullptr;
+    }
+    const size_t osize = ets_malloc_round (total);
+    void *object;
+    if (!osize || heap_detail::alloc_zeroed_object (&object, osize)) {
+        errno = ENOMEM;
+        return nullptr;
+    }
+    return object;
+}
+
+ETS_EXPORT void *realloc (void *object, size_t size) __THROW
+{
+    if (!object) {
+        return malloc (size);
+    }
+    if (!size) {
+        free (object);
+        return nullptr;
+    }
+    const size_t osize = ets_malloc_round (size);
+    if (!osize || heap_detail::realloc_object (&object, osize)) {
+        errno = ENOMEM;
+        return nullptr;
+    }
+    return object;
+}
+
+ETS_EXPORT void *reallocarray (void *object, size_t nmemb, size_t size) __THROW
+{
+    size_t total;
+    if (__builtin_mul_overflow (nmemb, size, &total)) {
+        errno = ENOMEM;
+        return nullptr;
+    }
+    return realloc (object, total);
+}
+
+ETS_EXPORT int posix_memalign (void **objectp, size_t align, size_t size) __THROW
+{
+    if (!align || (align & (align - 1)) || (align % sizeof (void *))) {
+        return EINVAL;
+    }
+    void *object = ets_malloc_aligned (align, size);
+    if (!object) {
+        return ENOMEM;
+    }
+    (*objectp) = object;
+    return 0;
+}
+
+ETS_EXPORT void *aligned_alloc (size_t align, size_t size) __THROW
+{
+    if (!align || (align & (align - 1))) {
+        errno = EINVAL;
+        return nullptr;
+    }
+    void *object = ets_malloc_aligned (align, size);
+    if (!object) {
+        errno = ENOMEM;
+    }
+    return object;
+}
+
+ETS_EXPORT void *memalign (size_t align, size_t size) __THROW
+{
+    /* like glibc, quietly round a bad alignment up to a power of two */
+    if (align & (align - 1)) {
+        align = 1ul << (64 - __builtin_clzl (align));
+    }
+    return aligned_alloc (align ? align : 1, size);
+}
+
+ETS_EXPORT void *valloc (size_t size) __THROW
+{
+    return aligned_alloc (sysconf (_SC_PAGESIZE), size);
+}
+
+ETS_EXPORT void *pvalloc (size_t size) __THROW
+{
+    const size_t page_size = sysconf (_SC_PAGESIZE);
+    const size_t rounded = (size + page_size - 1) & ~(page_size - 1);
+    if (rounded < size) {
+        errno = ENOMEM;
+        return nullptr;
+    }
+    return aligned_alloc (page_size, rounded ? rounded : page_size);
+}
+
+ETS_EXPORT size_t malloc_usable_size (void *object) __THROW
+{
+    return object ? heap_detail::usable_size (object) : 0;
+}
+
+//! Make room in the calling thread's heap for `count` objects of `size`
+//! bytes, as malloc sizes them, so that allocating them never needs a fresh
+//! block; `flags` as for heap_detail::reserve (ETS_RESERVE_PREFAULT 1,
+//! ETS_RESERVE_PIN 2). 0, or ENOMEM if the room could not be made.
+//! The room is the calling thread's alone: other threads' heaps are not
+//! touched, so every thread that is to start warm must call this itself.
+ETS_EXPORT int ets_reserve (size_t size, size_t count, int flags) __THROW
+{
+    const size_t osize = ets_malloc_round (size);
+    if (!osize || heap_detail::reserve (osize, count, flags)) {
+        return ENOMEM;
+    }
+    return 0;
+}
+
+//! Defined by a program that links the library in to warm up before it
+//! starts: called once the library is loaded, on the loading thread.
+//! When the library is loaded as a shared object ahead of the program, as a
+//! dependency or with LD_PRELOAD, that is before the program's own
+//! constructors run; linked in statically, it runs among them, in whatever
+//! order the linker left the constructors. Under LD_PRELOAD, the library
+//! only sees the program's definition if the program exports it, i.e. was
+//! linked with -rdynamic (or --export-dynamic-symbol=ets_warmup).
+void ets_warmup (void) __attribute__ ((weak));
+}
+
+//! Reservations made at load for the loading thread, pinned and prefaulted:
+//! ETESIAN_RESERVE lists them as `size:count`, separated by commas. They
+//! warm the loading thread's heap only, which is the main thread's; threads
+//! started later begin cold unless they call `ets_reserve` themselves.
+#define ETS_MALLOC_RESERVE_ENV "ETESIAN_RESERVE"
+
+//! Warm-up at load: the reservations in ETS_MALLOC_RESERVE_ENV, then the
+//! program's `ets_warmup`, if any, both on the loading thread (see
+//! `ets_warmup` for when that is). A malformed entry ends the list.
+__attribute__ ((constructor)) static void ets_malloc_warmup ()
+{
+    const char *spec = getenv (ETS_MALLOC_RESERVE_ENV);
+    while (spec && *spec) {
+        char *end;
+        const size_t size = strtoul (spec, &end, 0);
+        if (end == spec || *end != ':') break;
+        spec = end + 1;
+        const size_t count = strtoul (spec, &end, 0);
+        if (end == spec || (*end != ',' && *end != '\0')) break;
+        spec = *end ? end + 1 : end;
+        ets_reserve (size, count, ETS_RESERVE_PREFAULT | ETS_RESERVE_PIN);
+    }
+    if (ets_warmup) {
+        ets_warmup ();
+    }
+}
@@ -0,0 +1,156 @@
+/* AUTHOR Maximilien M. Cura
+ */
+
+//! Replacements for the global `operator new` and `operator delete`, every
+//! variant, on top of heap_detail. Sized deletes pass the size on, so that
+//! small objects are freed without a look at their block header.
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <new>
+
+#include <etesian/liballoc/alloc.h>
+
+#define ETS_EXPORT __attribute__ ((visibility ("default")))
+
+//! `operator new` must return memory aligned for any type without an
+//! extended alignment.
+#define ETS_NEW_ALIGN ((size_t)__STDCPP_DEFAULT_NEW_ALIGNMENT__)
+
+namespace heap_detail = ets::alloc::heap_detail;
+
+//! Round a request up to a multiple of ETS_NEW_ALIGN (see malloc.cc); sized
+//! deletes round the same way, so they land on the same size class.
+//! Returns 0 on overflow.
+static inline size_t ets_new_round (size_t size)
+{
+    if (!size) return ETS_NEW_ALIGN;
+    const size_t rounded = (size + ETS_NEW_ALIGN - 1) & ~(ETS_NEW_ALIGN - 1);
+    return rounded < size ? 0 : rounded;
+}
+
+static inline void *ets_new_nothrow (size_t size, size_t align) noexcept
+{
+    const size_t osize = ets_new_round (size);
+    if (!osize) return nullptr;
+    if (align <= ETS_NEW_ALIGN) {
+        return ets::alloc::alloc (osize);
+    }
+    void *object;
+    if (heap_detail::alloc_aligned_object (&object, align, osize)) {
+        return nullptr;
+    }
+    return object;
+}
+
+static void *ets_new (size_t size, size_t align)
+{
+    for (;;) {
+        void *object = ets_new_nothrow (size, align);
+        if (object) return object;
+        std::new_handler handler = std::get_new_handler ();
+        if (!handler) throw std::bad_alloc ();
+        handler ();
+    }
+}
+
+static inline void ets_delete (void *object) noexcept
+{
+    if (object) {
+        heap_detail::dealloc_object (object);
+    }
+}
+
+static inline void ets_delete_sized (void *object, size_t size, size_t align) noexcept
+{
+    if (!object) return;
+    /* over-aligned objects may have been placed in a larger class */
+    if (align <= ETS_NEW_ALIGN) {
+        ets::alloc::dealloc (object, ets_new_round (size));
+    } else {
+        heap_detail::dealloc_object (object);
+    }
+}
+
+ETS_EXPORT void *operator new (size_t size)
+{
+    return ets_new (size, ETS_NEW_ALIGN);
+}
+ETS_EXPORT void *operator new[] (size_t size)
+{
+    return ets_new (size, ETS_NEW_ALIGN);
+}
+ETS_EXPORT void *operator new (size_t size, std::nothrow_t const &) noexcept
+{
+    return ets_new_nothrow (size, ETS_NEW_ALIGN);
+}
+ETS_EXPORT void *operator new[] (size_t size, std::nothrow_t const &) noexcept
+{
+    return ets_new_nothrow (size, ETS_NEW_ALIGN);
+}
+ETS_EXPORT void *operator new (size_t size, std::align_val_t align)
+{
+    return ets_new (size, (size_t)align);
+}
+ETS_EXPORT void *operator new[] (size_t size, std::align_val_t align)
+{
+    return ets_new (size, (size_t)align);
+}
+ETS_EXPORT void *operator new (size_t size, std::align_val_t align, std::nothrow_t const &) noexcept
+{
+    return ets_new_nothrow (size, (size_t)align);
+}
+ETS_EXPORT void *operator new[] (size_t size, std::align_val_t align, std::nothrow_t const &) noexcept
+{
+    return ets_new_nothrow (size, (size_t)align);
+}
+
+ETS_EXPORT void operator delete (void *object) noexcept
+{
+    ets_delete (object);
+}
+ETS_EXPORT void operator delete[] (void *object) noexcept
+{
+    ets_delete (object);
+}
+ETS_EXPORT void operator delete (void *object, std::nothrow_t const &) noexcept
+{
+    ets_delete (object);
+}
+ETS_EXPORT void operator delete[] (void *object, std::nothrow_t const &) noexcept
+{
+    ets_delete (object);
+}
+ETS_EXPORT void operator delete (void *object, size_t size) noexcept
+{
+    ets_delete_sized (object, size, ETS_NEW_ALIGN);
+}
+ETS_EXPORT void operator delete[] (void *object, size_t size) noexcept
+{
+    ets_delete_sized (object, size, ETS_NEW_ALIGN);
+}
+ETS_EXPORT void operator delete (void *object, std::align_val_t) noexcept
+{
+    ets_delete (object);
+}
+ETS_EXPORT void operator delete[] (void *object, std::align_val_t) noexcept
+{
+    ets_delete (object);
+}
+ETS_EXPORT void operator delete (void *object, std::align_val_t, std::nothrow_t const &) noexcept
+{
+    ets_delete (object);
+}
+ETS_EXPORT void operator delete[] (void *object, std::align_val_t, std::nothrow_t const &) noexcept
+{
+    ets_delete (object);
+}
+ETS_EXPORT void operator delete (void *object, size_t size, std::align_val_t align) noexcept
+{
+    ets_delete_sized (object, size, (size_t)align);
+}
+ETS_EXPORT void operator delete[] (void *object, size_t size, std::align_val_t align) noexcept
+{
+    ets_delete_sized (object, size, (size_t)align);
+}
@@ -3,27 +3,93 @@
 
 #include <etesian/liballoc/thread_support.h>
 
+#include <sched.h>
+#include <time.h>
+#include <limits.h>
+#if __linux__
+    #include <linux/futex.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+#endif
+
 using ets::alloc::thread_support::PThreadMutex;
 
-PThreadMutex::PThreadMutex ()
+static inline void ets_cpu_relax ()
 {
-    pthread_mutex_init (&inner, NULL);
+#if defined __x86_64__ || defined __i386__
+    __builtin_ia32_pause ();
+#elif defined __aarch64__
+    __asm__ __volatile__ ("yield");
+#endif
 }
 
-PThreadMutex::~PThreadMutex ()
+void ets_lock_acquire_slow (ets_lock_t *lock)
+{
+    for (int i = 0; i < ETS_LOCK_SPIN; ++i) {
+        ets_cpu_relax ();
+        if (0 == __atomic_load_n (&lock->lk_state, __ATOMIC_RELAXED) && ets_lock_try_acquire (lock)) {
+            return;
+        }
+    }
+    /* mark the lock contended, so that its holder wakes us on release */
+    while (0 != __atomic_exchange_n (&lock->lk_state, 2, __ATOMIC_ACQUIRE)) {
+#if __linux__
+        syscall (SYS_futex, &lock->lk_state, FUTEX_WAIT_PRIVATE, 2, nullptr, nullptr, 0);
+#else
+        sched_yield ();
+#endif
+    }
+}
+
+void ets_lock_release_slow (ets_lock_t *lock)
+{
+#if __linux__
+    syscall (SYS_futex, &lock->lk_state, FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+#else
+    (void)lock;
+#endif
+}
+
+void ets_wait_on (uint32_t *word, uint32_t expected, uint64_t timeout_ns)
 {
-    pthread_mutex_destroy (&inner);
+    struct timespec timeout = {
+        .tv_sec = (time_t)(timeout_ns / 1000000000ul),
+        .tv_nsec = (long)(timeout_ns % 1000000000ul),
+    };
+#if __linux__
+    syscall (SYS_futex, word, FUTEX_WAIT_PRIVATE, expected, &timeout, nullptr, 0);
+#else
+    if (expected == __atomic_load_n (word, __ATOMIC_ACQUIRE)) {
+        nanosleep (&timeout, nullptr);
+    }
+#endif
 }
+
+void ets_wake_all (uint32_t *word)
+{
+#if __linux__
+    syscall (SYS_futex, word, FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+#else
+    (void)word;
+#endif
+}
+
+PThreadMutex::PThreadMutex ()
+{
+    ets_lock_init (&inner);
+}
+
+PThreadMutex::~PThreadMutex ()
+{ }
 void PThreadMutex::lock ()
 {
-    pthread_mutex_lock (&inner);
+    ets_lock_acquire (&inner);
 }
 void PThreadMutex::unlock ()
 {
-    pthread_mutex_unlock (&inner);
+    ets_lock_release (&inner);
 }
 bool PThreadMutex::try_lock ()
 {
-    const int r = pthread_mutex_trylock (&inner);
-    return r == 0;
+    return ets_lock_try_acquire (&inner);
 }
\ No newline at end of file
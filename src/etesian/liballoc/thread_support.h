@@ -7,7 +7,8 @@
 #include <etesian/libcore/rt-object.h>
 #include <etesian/libcore/rt-var.h>
 
-#include <pthread.h>
+#include <etesian/liballoc/lock.h>
+
 #include <type_traits>
 
 namespace ets::alloc::thread_support {
@@ -66,9 +67,10 @@ namespace ets::alloc::thread_support {
         }
     };
 
+    //! Named for the pthread mutex it used to wrap; now an ets_lock_t.
     struct PThreadMutex
     {
-        pthread_mutex_t inner = PTHREAD_MUTEX_INITIALIZER;
+        ets_lock_t inner = ETS_LOCK_INIT;
 
         PThreadMutex ();
         ~PThreadMutex ();
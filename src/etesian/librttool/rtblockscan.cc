@@ -0,0 +1,143 @@
+/* AUTHOR Maximilien M. Cura
+ */
+
+//! rtblockscan: measure how block colouring spreads a scan over cache sets.
+//!
+//!     rtblockscan [-s OSIZE] [-b NBLOCKS] [-r ROUNDS] [-1 L1SETS] [-2 L2SETS]
+//!
+//! Allocates OSIZE-byte objects (1024 by default) until they come from
+//! NBLOCKS distinct blocks (512), then reads the first object of every block,
+//! ROUNDS times over (10000). The same scan is then run over the addresses
+//! the objects would have without colouring, that is at one and the same
+//! offset into every block. For both, the number of L1 and L2 sets touched
+//! (given L1SETS and L2SETS sets of ETS_CACHE_LINE_SIZE-byte lines; 64 and
+//! 1024 by default), the most lines landing on any one of them, and the time
+//! per read are reported.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <vector>
+
+#include <etesian/liballoc/alloc.h>
+#include <etesian/liballoc/alloc-impl.h>
+
+namespace {
+    struct SetUse
+    {
+        size_t nsets_touched;
+        size_t max_lines_per_set;
+    };
+
+    SetUse set_use (std::vector<uint8_t *> const &addresses, size_t nsets)
+    {
+        std::map<size_t, size_t> lines;
+        for (uint8_t *address : addresses) {
+            ++lines[((uintptr_t)address / ETS_CACHE_LINE_SIZE) % nsets];
+        }
+        SetUse use{ lines.size (), 0 };
+        for (auto const &[set, count] : lines) {
+            use.max_lines_per_set = std::max (use.max_lines_per_set, count);
+        }
+        return use;
+    }
+
+    //! Nanoseconds per read over `rounds` passes of `addresses`.
+    double scan (std::vector<uint8_t *> const &addresses, size_t rounds)
+    {
+        uint64_t sink = 0;
+        const auto start = std::chrono::steady_clock::now ();
+        for (size_t r = 0; r < rounds; ++r) {
+            for (uint8_t *address : addresses) {
+                sink += *(volatile uint64_t *)address;
+            }
+        }
+        const auto stop = std::chrono::steady_clock::now ();
+        asm volatile ("" : : "r"(sink));
+        return std::chrono::duration<double, std::nano> (stop - start).count ()
+               / (double)(rounds * addresses.size ());
+    }
+
+    void report (const char *name, std::vector<uint8_t *> const &addresses, size_t rounds,
+                 size_t l1_sets, size_t l2_sets)
+    {
+        const SetUse l1 = set_use (addresses, l1_sets), l2 = set_use (addresses, l2_sets);
+        /* once to warm up, once for the record */
+        scan (addresses, rounds);
+        const double ns = scan (addresses, rounds);
+        fprintf (stderr, "%-10s %6zu %8zu %6zu %8zu %9.2f\n", name, l1.nsets_touched,
+                 l1.max_lines_per_set, l2.nsets_touched, l2.max_lines_per_set, ns);
+    }
+
+    [[noreturn]] void usage (const char *argv0)
+    {
+        fprintf (stderr, "usage: %s [-s OSIZE] [-b NBLOCKS] [-r ROUNDS] [-1 L1SETS] [-2 L2SETS]\n", argv0);
+        exit (2);
+    }
+}
+
+int main (int argc, char **argv)
+{
+    size_t osize = 1024;
+    size_t nblocks = 512;
+    size_t rounds = 10000;
+    size_t l1_sets = 64;
+    size_t l2_sets = 1024;
+
+    int opt;
+    while (-1 != (opt = getopt (argc, argv, "s:b:r:1:2:"))) {
+        switch (opt) {
+            case 's': osize = strtoul (optarg, nullptr, 0); break;
+            case 'b': nblocks = strtoul (optarg, nullptr, 0); break;
+            case 'r': rounds = strtoul (optarg, nullptr, 0); break;
+            case '1': l1_sets = strtoul (optarg, nullptr, 0); break;
+            case '2': l2_sets = strtoul (optarg, nullptr, 0); break;
+            default: usage (argv[0]);
+        }
+    }
+    if (optind != argc) usage (argv[0]);
+    if (!osize || osize > ets_rlup_sli (ETS_LKGI_MEDIUM - 1)) {
+        fprintf (stderr, "OSIZE must be in [1, %zu]: medium and large objects are not coloured per block\n",
+                 ets_rlup_sli (ETS_LKGI_MEDIUM - 1));
+        return 2;
+    }
+    if (!nblocks || !rounds || !l1_sets || !l2_sets) usage (argv[0]);
+
+    /* the lowest object of each block is the first one carved from it */
+    std::vector<void *> objects;
+    std::map<uintptr_t, uint8_t *> first_objects;
+    while (first_objects.size () < nblocks) {
+        void *object = ets::alloc::alloc (osize);
+        if (!object) {
+            fprintf (stderr, "out of memory after %zu objects\n", objects.size ());
+            return 1;
+        }
+        objects.push_back (object);
+        uint8_t *&first = first_objects[(uintptr_t)object & ~(ETS_BLOCK_SIZE - 1)];
+        if (!first || (uint8_t *)object < first) first = (uint8_t *)object;
+    }
+
+    std::vector<uint8_t *> coloured, uncoloured;
+    const uintptr_t offset = (uintptr_t)first_objects.begin ()->second & (ETS_BLOCK_SIZE - 1);
+    for (auto const &[block, first] : first_objects) {
+        coloured.push_back (first);
+        uncoloured.push_back ((uint8_t *)(block + offset));
+    }
+
+    fprintf (stderr, "%zu blocks of %zu-byte objects, %zu rounds\n", nblocks, ets_rlup_sli (ets_lup_sli (osize)),
+             rounds);
+    fprintf (stderr, "%-10s %6s %8s %6s %8s %9s\n", "layout", "L1sets", "L1max", "L2sets", "L2max", "ns/read");
+    report ("coloured", coloured, rounds, l1_sets, l2_sets);
+    report ("uncoloured", uncoloured, rounds, l1_sets, l2_sets);
+
+    for (void *object : objects) {
+        ets::alloc::heap_detail::dealloc_object (object);
+    }
+    return 0;
+}
@@ -0,0 +1,170 @@
+/* AUTHOR Maximilien M. Cura
+ */
+
+//! rtcrossfree: stress frees of objects allocated on other threads.
+//!
+//!     rtcrossfree [-t NTHREADS] [-s MAXSIZE] [-n ITERATIONS] [-r ROUNDS] [-k NSLOTS] [-a MAXALIGN]
+//!
+//! NTHREADS threads (8 by default) share NSLOTS slots (4096). Each picks a
+//! slot at random, ITERATIONS times (300000): if the slot holds an object, it
+//! takes it out and frees it, most likely on a thread other than the one that
+//! allocated it; otherwise it allocates an object of 1 to MAXSIZE bytes
+//! (16000) and puts it there. Every object is stamped with its slot and size,
+//! which are checked before it is freed, so that an object handed out twice
+//! is caught. The threads exit at the end of every one of ROUNDS rounds (4),
+//! leaving their objects in the slots for the next round's threads to free,
+//! from blocks whose heaps have been abandoned and adopted in the meantime.
+//! With MAXALIGN, objects are allocated aligned to a power of two of up to
+//! MAXALIGN bytes, picked at random, and their alignment is checked too.
+//! Before the rounds, `malloc (SIZE_MAX)` must fail with ENOMEM rather
+//! than hand out an object of some small class.
+//! Exits 0 once every round has run and the slots have been emptied.
+
+#include <errno.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <etesian/liballoc/alloc.h>
+#include <etesian/liballoc/alloc-impl.h>
+
+namespace {
+    struct Stamp
+    {
+        uint64_t slot;
+        uint64_t osize;
+    };
+
+    std::vector<std::atomic<void *>> slots;
+    std::atomic<size_t> nbad{ 0 };
+
+    void *alloc_stamped (size_t slot, size_t osize, size_t align)
+    {
+        void *object;
+        if (align ? ets::alloc::heap_detail::alloc_aligned_object (&object, align, osize)
+                  : ets::alloc::heap_detail::alloc_object (&object, osize)) {
+            return nullptr;
+        }
+        if (align && ((uintptr_t)object & (align - 1))) {
+            if (!nbad.fetch_add (1)) fprintf (stderr, "object %p is not aligned to %zu\n", object, align);
+        }
+        if (ets::alloc::heap_detail::usable_size (object) >= sizeof (Stamp)) {
+            const Stamp stamp{ slot, osize };
+            memcpy (object, &stamp, sizeof stamp);
+        }
+        return object;
+    }
+
+    void free_checked (size_t slot, void *object)
+    {
+        /* objects too small for a stamp go unchecked */
+        const size_t usable = ets::alloc::heap_detail::usable_size (object);
+        Stamp stamp{ slot, 0 };
+        if (usable >= sizeof stamp) memcpy (&stamp, object, sizeof stamp);
+        if (stamp.slot != slot || usable < stamp.osize) {
+            if (!nbad.fetch_add (1)) {
+                fprintf (stderr, "object %p in slot %zu has stamp (%zu, %zu)\n", object, slot,
+                         (size_t)stamp.slot, (size_t)stamp.osize);
+            }
+        }
+        ets::alloc::heap_detail::dealloc_object (object);
+    }
+
+    void run (size_t id, size_t max_size, size_t max_align, size_t iterations)
+    {
+        uint64_t state = (id + 1) * 0x9e3779b97f4a7c15u;
+        const auto next = [&state] {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            return state;
+        };
+        for (size_t i = 0; i < iterations; ++i) {
+            const size_t slot = next () % slots.size ();
+            if (void *object = slots[slot].exchange (nullptr)) {
+                free_checked (slot, object);
+                continue;
+            }
+            const size_t osize = 1 + next () % max_size;
+            const size_t align = max_align ? (size_t)1 << next () % (__builtin_ctzl (max_align) + 1) : 0;
+            void *object = alloc_stamped (slot, osize, align);
+            if (!object) {
+                if (!nbad.fetch_add (1)) fprintf (stderr, "failed to allocate %zu bytes\n", osize);
+                continue;
+            }
+            void *expected = nullptr;
+            if (!slots[slot].compare_exchange_strong (expected, object)) {
+                free_checked (slot, object);
+            }
+        }
+    }
+
+    [[noreturn]] void usage (const char *argv0)
+    {
+        fprintf (stderr, "usage: %s [-t NTHREADS] [-s MAXSIZE] [-n ITERATIONS] [-r ROUNDS] [-k NSLOTS] [-a MAXALIGN]\n", argv0);
+        exit (2);
+    }
+}
+
+int main (int argc, char **argv)
+{
+    size_t nthreads = 8;
+    size_t max_size = 16000;
+    size_t iterations = 300000;
+    size_t rounds = 4;
+    size_t nslots = 4096;
+    size_t max_align = 0;
+
+    int opt;
+    while (-1 != (opt = getopt (argc, argv, "t:s:n:r:k:a:"))) {
+        switch (opt) {
+            case 't': nthreads = strtoul (optarg, nullptr, 0); break;
+            case 's': max_size = strtoul (optarg, nullptr, 0); break;
+            case 'n': iterations = strtoul (optarg, nullptr, 0); break;
+            case 'r': rounds = strtoul (optarg, nullptr, 0); break;
+            case 'k': nslots = strtoul (optarg, nullptr, 0); break;
+            case 'a': max_align = strtoul (optarg, nullptr, 0); break;
+            default: usage (argv[0]);
+        }
+    }
+    if (optind != argc || !nthreads || !max_size || !rounds || !nslots || (max_align & (max_align - 1))) usage (argv[0]);
+
+    {
+        /* volatile, so that the compiler cannot decide the call's fate */
+        volatile size_t huge = SIZE_MAX;
+        errno = 0;
+        void *object = malloc (huge);
+        if (object || ENOMEM != errno) {
+            nbad.fetch_add (1);
+            fprintf (stderr, "malloc (SIZE_MAX) returned %p with errno %i\n", object, errno);
+            free (object);
+        }
+    }
+
+    slots = std::vector<std::atomic<void *>> (nslots);
+    for (size_t round = 0; round < rounds; ++round) {
+        std::vector<std::thread> threads;
+        for (size_t t = 0; t < nthreads; ++t) {
+            threads.emplace_back (run, round * nthreads + t, max_size, max_align, iterations);
+        }
+        for (std::thread &thread : threads) {
+            thread.join ();
+        }
+    }
+    for (size_t slot = 0; slot < nslots; ++slot) {
+        if (void *object = slots[slot].exchange (nullptr)) {
+            free_checked (slot, object);
+        }
+    }
+
+    fprintf (stderr, "%zu threads x %zu rounds x %zu iterations, objects of up to %zu bytes: %zu bad\n", nthreads,
+             rounds, iterations, max_size, nbad.load ());
+    return nbad.load () ? 1 : 0;
+}
@@ -0,0 +1,279 @@
+/* AUTHOR Maximilien M. Cura
+ */
+
+//! rtsizeclass: fit the small size classes to a recorded size histogram.
+//!
+//!     rtsizeclass [-l LIMIT] [-g GRANULE] [-n NCLASSES] [-o HEADER] HISTOGRAM
+//!
+//! HISTOGRAM holds one `<size> <count>` pair per line (`#` starts a comment,
+//! `-` reads standard input). Classes up to LIMIT (a power of two, at most
+//! 2048; 256 by default) are chosen among the multiples of GRANULE (16 by
+//! default, which keeps malloc's alignment) so as to minimize the expected
+//! internal fragmentation; classes past LIMIT keep to the geometric schedule.
+//! The expected waste of the geometric schedule and of every candidate table
+//! is reported on standard error; the table with NCLASSES classes in range
+//! (by default, as many as the geometric schedule has there, which keeps the
+//! linkage count unchanged) is written to HEADER as `sli-tuned.h`, for
+//! building with ETS_FEATURE_TUNED_SIZE_CLASSES.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <map>
+#include <vector>
+
+#include <etesian/liballoc/alloc-impl.h>
+
+namespace {
+    struct Histogram
+    {
+        std::map<size_t, uint64_t> counts;
+        //! Largest geometric class; anything past it takes the large path.
+        size_t top_osize;
+    };
+
+    struct Waste
+    {
+        uint64_t wasted;
+        uint64_t served;
+
+        double percent () const
+        {
+            return served ? 100.0 * (double)wasted / (double)served : 0.0;
+        }
+    };
+
+    //! Expected waste of `classes` (ascending, ending at `limit`) over the
+    //! histogram, split into the tuned range and the whole small/medium range.
+    void measure (Histogram const &hist, std::vector<size_t> const &classes, size_t limit,
+                  Waste &in_range, Waste &total)
+    {
+        in_range = {};
+        total = {};
+        size_t ci = 0;
+        for (auto const &[osize, count] : hist.counts) {
+            if (osize > hist.top_osize) break;
+            size_t class_osize;
+            if (osize <= limit) {
+                while (classes[ci] < osize) ++ci;
+                class_osize = classes[ci];
+                in_range.wasted += count * (class_osize - osize);
+                in_range.served += count * class_osize;
+            } else {
+                class_osize = ets_sli_geometric_osize (ets_sli_geometric_lup (osize));
+            }
+            total.wasted += count * (class_osize - osize);
+            total.served += count * class_osize;
+        }
+    }
+
+    //! Classes in (0, limit] minimizing expected waste, as multiples of
+    //! `granule`, the last of which is `limit` itself.
+    std::vector<size_t> fit (Histogram const &hist, size_t limit, size_t granule, size_t nclasses)
+    {
+        const size_t ncandidates = limit / granule;
+        if (nclasses > ncandidates) nclasses = ncandidates;
+
+        /* prefix sums over candidate boundaries: objects (and their bytes) of
+         * at most `j * granule` bytes */
+        std::vector<uint64_t> nobjects (ncandidates + 1, 0), nbytes (ncandidates + 1, 0);
+        for (auto const &[osize, count] : hist.counts) {
+            if (osize > limit) break;
+            const size_t j = (osize + granule - 1) / granule;
+            nobjects[j] += count;
+            nbytes[j] += count * osize;
+        }
+        for (size_t j = 1; j <= ncandidates; ++j) {
+            nobjects[j] += nobjects[j - 1];
+            nbytes[j] += nbytes[j - 1];
+        }
+        auto cost = [&] (size_t i, size_t j) -> uint64_t {
+            return j * granule * (nobjects[j] - nobjects[i]) - (nbytes[j] - nbytes[i]);
+        };
+
+        const uint64_t infinity = UINT64_MAX;
+        std::vector<std::vector<uint64_t>> best (nclasses + 1, std::vector<uint64_t> (ncandidates + 1, infinity));
+        std::vector<std::vector<size_t>> from (nclasses + 1, std::vector<size_t> (ncandidates + 1, 0));
+        best[0][0] = 0;
+        for (size_t k = 1; k <= nclasses; ++k) {
+            for (size_t j = k; j <= ncandidates; ++j) {
+                for (size_t i = k - 1; i < j; ++i) {
+                    if (infinity == best[k - 1][i]) continue;
+                    const uint64_t c = best[k - 1][i] + cost (i, j);
+                    if (c < best[k][j]) {
+                        best[k][j] = c;
+                        from[k][j] = i;
+                    }
+                }
+            }
+        }
+
+        std::vector<size_t> classes (nclasses);
+        for (size_t k = nclasses, j = ncandidates; k > 0; j = from[k][j], --k) {
+            classes[k - 1] = j * granule;
+        }
+        return classes;
+    }
+
+    bool read_histogram (const char *path, Histogram &hist)
+    {
+        FILE *fp = strcmp (path, "-") ? fopen (path, "r") : stdin;
+        if (!fp) {
+            perror (path);
+            return false;
+        }
+        char line[256];
+        size_t lineno = 0;
+        while (fgets (line, sizeof line, fp)) {
+            ++lineno;
+            char *comment = strchr (line, '#');
+            if (comment) *comment = '\0';
+            unsigned long long osize, count;
+            char trailing;
+            const int n = sscanf (line, "%llu %llu %c", &osize, &count, &trailing);
+            if (n <= 0) continue;
+            if (n != 2 || !osize) {
+                fprintf (stderr, "%s:%zu: expected `<size> <count>`\n", path, lineno);
+                if (fp != stdin) fclose (fp);
+                return false;
+            }
+            hist.counts[osize] += count;
+        }
+        if (fp != stdin) fclose (fp);
+        return true;
+    }
+
+    bool write_header (const char *path, const char *histogram_path, std::vector<size_t> const &classes,
+                       size_t limit, size_t granule, Waste const &tuned, Waste const &geometric)
+    {
+        FILE *fp = strcmp (path, "-") ? fopen (path, "w") : stdout;
+        if (!fp) {
+            perror (path);
+            return false;
+        }
+        fprintf (fp,
+                 "/* Generated by rtsizeclass from %s; do not edit.\n"
+                 " * Expected waste up to %zu bytes: %.2f%% (geometric schedule: %.2f%%)\n"
+                 " */\n"
+                 "\n"
+                 "#pragma once\n"
+                 "\n"
+                 "#define ETS_SLI_TUNED_LIMIT %zu\n"
+                 "#define ETS_SLI_TUNED_GRANULE %zu\n"
+                 "#define ETS_SLI_TUNED_OSIZES",
+                 histogram_path, limit, tuned.percent (), geometric.percent (), limit, granule);
+        for (size_t i = 0; i < classes.size (); ++i) {
+            fprintf (fp, "%s %zu", i ? "," : "", classes[i]);
+        }
+        fprintf (fp, "\n");
+        if (fp != stdout) fclose (fp);
+        return true;
+    }
+
+    [[noreturn]] void usage (const char *argv0)
+    {
+        fprintf (stderr, "usage: %s [-l LIMIT] [-g GRANULE] [-n NCLASSES] [-o HEADER] HISTOGRAM\n", argv0);
+        exit (2);
+    }
+}
+
+int main (int argc, char **argv)
+{
+    size_t limit = 256;
+    size_t granule = 16;
+    size_t nclasses = 0;
+    const char *header_path = nullptr;
+
+    int opt;
+    while (-1 != (opt = getopt (argc, argv, "l:g:n:o:"))) {
+        switch (opt) {
+            case 'l': limit = strtoul (optarg, nullptr, 0); break;
+            case 'g': granule = strtoul (optarg, nullptr, 0); break;
+            case 'n': nclasses = strtoul (optarg, nullptr, 0); break;
+            case 'o': header_path = optarg; break;
+            default: usage (argv[0]);
+        }
+    }
+    if (optind + 1 != argc) usage (argv[0]);
+    if (!limit || (limit & (limit - 1)) || limit < 16 || limit > 2048) {
+        fprintf (stderr, "LIMIT must be a power of two in [16, 2048]\n");
+        return 2;
+    }
+    if (granule < 8 || (granule & (granule - 1)) || granule > limit) {
+        fprintf (stderr, "GRANULE must be a power of two in [8, LIMIT]\n");
+        return 2;
+    }
+
+    Histogram hist;
+    hist.top_osize = ets_sli_geometric_osize (ETS_SLI_GEOMETRIC_NLKGS - 1);
+    if (!read_histogram (argv[optind], hist)) return 1;
+
+    /* the geometric schedule, restricted to the tuned range */
+    std::vector<size_t> geometric;
+    for (size_t gi = 1; ets_sli_geometric_osize (gi) <= limit; ++gi) {
+        geometric.push_back (ets_sli_geometric_osize (gi));
+    }
+    if (!nclasses) nclasses = geometric.size ();
+    if (nclasses > limit / granule) nclasses = limit / granule;
+    if (ETS_SLI_GEOMETRIC_NLKGS + nclasses - geometric.size () > 256) {
+        fprintf (stderr, "too many classes\n");
+        return 2;
+    }
+
+    uint64_t nlarge = 0;
+    for (auto it = hist.counts.upper_bound (hist.top_osize); it != hist.counts.end (); ++it) {
+        nlarge += it->second;
+    }
+
+    Waste geometric_in_range, geometric_total;
+    measure (hist, geometric, limit, geometric_in_range, geometric_total);
+    fprintf (stderr, "%-12s %8s %12s %12s\n", "table", "linkages", "waste<=limit", "waste total");
+    fprintf (stderr, "%-12s %8d %11.2f%% %11.2f%%\n", "geometric", ETS_SLI_GEOMETRIC_NLKGS,
+             geometric_in_range.percent (), geometric_total.percent ());
+
+    /* candidates from half the geometric density up to twice it, plus the
+     * one asked for */
+    std::vector<size_t> candidates;
+    const size_t max_nclasses = limit / granule;
+    for (size_t k = geometric.size () / 2 ? geometric.size () / 2 : 1;
+         k <= 2 * geometric.size () && k <= max_nclasses; ++k) {
+        candidates.push_back (k);
+    }
+    if (nclasses < candidates.front () || nclasses > candidates.back ()) {
+        candidates.push_back (nclasses);
+    }
+
+    std::vector<size_t> chosen;
+    Waste chosen_in_range{};
+    for (size_t k : candidates) {
+        const std::vector<size_t> classes = fit (hist, limit, granule, k);
+        Waste in_range, total;
+        measure (hist, classes, limit, in_range, total);
+        char name[32];
+        snprintf (name, sizeof name, "tuned/%zu%s", k, k == nclasses ? "*" : "");
+        fprintf (stderr, "%-12s %8zu %11.2f%% %11.2f%%\n", name,
+                 ETS_SLI_GEOMETRIC_NLKGS + k - geometric.size (), in_range.percent (), total.percent ());
+        if (k == nclasses) {
+            chosen = classes;
+            chosen_in_range = in_range;
+        }
+    }
+    if (nlarge) {
+        fprintf (stderr, "(%llu objects past %zu bytes take the large path and are not counted)\n",
+                 (unsigned long long)nlarge, hist.top_osize);
+    }
+
+    fprintf (stderr, "classes:");
+    for (size_t osize : chosen) fprintf (stderr, " %zu", osize);
+    fprintf (stderr, "\n");
+
+    if (header_path && !write_header (header_path, argv[optind], chosen, limit, granule,
+                                      chosen_in_range, geometric_in_range)) {
+        return 1;
+    }
+    return 0;
+}